@@ -0,0 +1,203 @@
+//===========================================================================
+// approx.hpp
+//===========================================================================
+// @brief: This header file defines the log, exp and normal CDF
+//         implementations the pricing pipeline can be built with.
+
+#ifndef APPROX_HPP
+#define APPROX_HPP
+
+#include <cmath>
+#include <cstdint>
+
+// Each math policy provides, for float arguments:
+//   - log(x):       natural log, x > 0
+//   - exp(x):       e^x (0 below the float range, FLT_MAX above)
+//   - cdf(x):       standard normal CDF
+//   - cdf(x, pdf):  the CDF, with pdf set to the standard normal density
+//
+// Policies:
+//   - MathLibm:               std::log / std::exp, and the CDF from the
+//                             Abramowitz-Stegun polynomial (which needs an
+//                             exp and a division)
+//   - MathTable<SEG_BITS>:    linear interpolation in 2^SEG_BITS segments
+//   - MathPoly<SEG_BITS>:     quadratic interpolation in 2^SEG_BITS segments
+//
+// The table policies reduce each function to the unit interval, look the
+// segment up and evaluate a degree-1 or degree-2 polynomial: one or two
+// multiply-adds after a ROM read, against the iterative float log / exp
+// cores and divider of MathLibm.
+//   - log(x):  x = 2^e * m, log(x) = e log(2) + log(m), m in [1, 2) taken
+//              straight from the float bits
+//   - exp(x):  e^x = 2^k * 2^f, f in [0, 1), 2^k added to the float exponent
+//   - cdf(x):  N(|x|) on [0, APPROX_CDF_RANGE), 1 beyond; N(-x) = 1 - N(x)
+//
+// Interpolation error with h = 2^-SEG_BITS, before float rounding (about
+// 6e-8, and for exp the rounding of x log2(e), about 1e-6 at |x| = 20):
+//                    MathTable (linear)        MathPoly (quadratic)
+//   log, absolute    h^2 / 8                   0.016 h^3
+//   exp, relative    0.12 h^2                  0.0054 h^3
+//   cdf, absolute    1.94 h^2                  1.64 h^3
+// e.g. MathTable<10>: 1.9e-6 on the CDF; MathPoly<6>: 6.3e-6, MathPoly<8>:
+// 1e-7.
+#define APPROX_CDF_RANGE 8
+
+// Synthesis turns a table built inside the function that reads it into a
+// ROM; a software build would rebuild it on every call, so there it is a
+// static, built on first use
+#ifdef __SYNTHESIS__
+#define APPROX_TABLE const
+#else
+#define APPROX_TABLE static const
+#endif
+
+// ===============================================================
+// MathLibm
+// ===============================================================
+
+struct MathLibm {
+  static float log(float x) {
+  #pragma HLS INLINE
+    return std::log(x);
+  }
+
+  static float exp(float x) {
+  #pragma HLS INLINE
+    return std::exp(x);
+  }
+
+  static float cdf(float x, float &pdf) {
+  #pragma HLS INLINE
+    const float a1 = 0.31938153f;
+    const float a2 = -0.356563782f;
+    const float a3 = 1.781477937f;
+    const float a4 = -1.821255978f;
+    const float a5 = 1.330274429f;
+
+    float L = (x >= 0.0f) ? x : -x;
+    float k = 1.0f / (1.0f + 0.2316419f * L);
+
+    float w = ((((a5 * k + a4) * k + a3) * k + a2) * k + a1) * k;
+
+    float exponent = -0.5f * L * L;
+
+    pdf = float(0.3989422804014327f) * std::exp(exponent);
+
+    w = w * pdf;
+
+    return (x >= 0.0f) ? (1.0f - w) : w;
+  }
+
+  static float cdf(float x) {
+  #pragma HLS INLINE
+    float pdf;
+    return cdf(x, pdf);
+  }
+};
+
+// ===============================================================
+// Piecewise polynomials
+// ===============================================================
+
+// Functions on the unit interval that the table policies tabulate
+struct ApproxLogGrid {    // log(m), m = 1 + t
+  static double at(double t) { return std::log(1.0 + t); }
+};
+struct ApproxExp2Grid {   // 2^t
+  static double at(double t) { return std::exp2(t); }
+};
+struct ApproxCdfGrid {    // N(x), x = APPROX_CDF_RANGE * t
+  static double at(double t) { return 0.5 * std::erfc(-t * APPROX_CDF_RANGE / std::sqrt(2.0)); }
+};
+
+/**
+ * F::at on [0, 1] in 2^SEG_BITS segments, each a polynomial of DEGREE 1
+ * or 2 in the offset u in [0, 1) within the segment, interpolating F at
+ * the segment ends (and its midpoint for DEGREE 2). The coefficients only
+ * depend on constants, so a table built inside the function that uses it
+ * synthesizes to a ROM (see APPROX_TABLE).
+ */
+template<class F, int SEG_BITS, int DEGREE>
+struct Piecewise {
+  static const int SEGMENTS = 1 << SEG_BITS;
+  float c[DEGREE + 1][SEGMENTS];
+
+  Piecewise() {
+    PIECEWISE_INIT: for (int i = 0; i < SEGMENTS; i++) {
+      double f0 = F::at((double)i / SEGMENTS);
+      double f1 = F::at((double)(i + 1) / SEGMENTS);
+      if (DEGREE == 1) {
+        c[0][i] = f0;
+        c[1][i] = f1 - f0;
+      } else {
+        double fm = F::at((i + 0.5) / SEGMENTS);
+        double c2 = 2.0 * (f0 - 2.0 * fm + f1);
+        c[0][i]      = f0;
+        c[1][i]      = f1 - f0 - c2;
+        c[DEGREE][i] = c2;      // c[2], spelled so DEGREE 1 still compiles
+      }
+    }
+  }
+
+  // pos = t * SEGMENTS, t in [0, 1)
+  float eval(float pos) const {
+  #pragma HLS INLINE
+    int   idx = (int)pos;
+    float u   = pos - idx;
+    float acc = c[DEGREE][idx];
+    PIECEWISE_EVAL: for (int d = DEGREE - 1; d >= 0; d--) {
+    #pragma HLS UNROLL
+      acc = c[d][idx] + u * acc;
+    }
+    return acc;
+  }
+};
+
+template<int SEG_BITS, int DEGREE>
+struct MathPiecewise {
+  static const int SEGMENTS = 1 << SEG_BITS;
+
+  static float log(float x) {
+  #pragma HLS INLINE
+    APPROX_TABLE Piecewise<ApproxLogGrid, SEG_BITS, DEGREE> table;
+    union { float f; uint32_t u; } b;
+    b.f = x;
+    int   e    = (int)((b.u >> 23) & 0xFF) - 127;
+    float mant = (float)(b.u & 0x7FFFFF) * (1.0f / (1 << 23));   // m - 1
+    return e * 0.69314718f + table.eval(mant * SEGMENTS);
+  }
+
+  static float exp(float x) {
+  #pragma HLS INLINE
+    APPROX_TABLE Piecewise<ApproxExp2Grid, SEG_BITS, DEGREE> table;
+    float y = x * 1.44269504f;                                    // log2(e)
+    if (y < -126.0f) return 0.0f;
+    if (y >= 128.0f) return 3.40282347e+38f;
+    int   k = (int)std::floor(y);
+    float p = table.eval((y - k) * SEGMENTS);                     // 2^f in [1, 2]
+    union { float f; uint32_t u; } b;
+    b.f  = p;
+    b.u += (uint32_t)k << 23;
+    return b.f;
+  }
+
+  static float cdf(float x) {
+  #pragma HLS INLINE
+    APPROX_TABLE Piecewise<ApproxCdfGrid, SEG_BITS, DEGREE> table;
+    float a = (x >= 0.0f) ? x : -x;
+    float N = (a < APPROX_CDF_RANGE)
+            ? table.eval(a * ((float)SEGMENTS / APPROX_CDF_RANGE)) : 1.0f;
+    return (x >= 0.0f) ? N : 1.0f - N;
+  }
+
+  static float cdf(float x, float &pdf) {
+  #pragma HLS INLINE
+    pdf = 0.3989422804014327f * exp(-0.5f * x * x);
+    return cdf(x);
+  }
+};
+
+template<int SEG_BITS> struct MathTable : MathPiecewise<SEG_BITS, 1> {};
+template<int SEG_BITS> struct MathPoly  : MathPiecewise<SEG_BITS, 2> {};
+
+#endif // APPROX_HPP
@@ -1,10 +1,19 @@
 #include "blackscholes.hpp"
 
+// Defaults until bs_set_params
 theta_type K = 200.0f; // Strike price
 theta_type r = 0.05f;  // Risk-free rate 
 theta_type v = 0.2f;   // Volatility of the underlying 
 theta_type T = 1.0f;   // One year until expiry
 
+// Feed clock (see bs_clock)
+static theta_type T_param    = T;   // T as last set by bs_set_params
+static bit64_t    expiry_ns  = 0;   // 0: T is T_param
+static bit64_t    clock_ns   = 0;   // feed time of the last refresh
+static bit64_t    clock_next = 0;   // feed time of the next one
+static bit64_t    feed_ns    = 0;   // feed time of the last message
+static bit64_t    chain_ns   = 0;   // feed time the loaded chain's maturities count from
+
 // Helper: float → bits
 bit32_t float_to_bits(float x) {
 #pragma HLS INLINE
@@ -21,39 +30,31 @@ float bits_to_float(bit32_t w) {
     return u.f;
 }
 
-static theta_type normal_cdf(theta_type x) {
+// Standard normal CDF at x, from the BS_MATH policy; pdf is set to the
+// standard normal density at x
+static theta_type normal_cdf(theta_type x, theta_type &pdf) {
 #pragma HLS INLINE
-    const theta_type a1 = 0.31938153f;
-    const theta_type a2 = -0.356563782f;
-    const theta_type a3 = 1.781477937f;
-    const theta_type a4 = -1.821255978f;
-    const theta_type a5 = 1.330274429f;
-
-    theta_type L = (x >= 0.0f) ? x : -x;
-    theta_type k = 1.0f / (1.0f + 0.2316419f * L);
-
-    theta_type w = ((((a5 * k + a4) * k + a3) * k + a2) * k + a1) * k;
-
-    theta_type exponent = -0.5f * L * L;
-
-    theta_type pdf = theta_type(0.3989422804014327f) * std::exp(exponent);
-
-    w = w * pdf;
+    return bs_math_t::cdf(x, pdf);
+}
 
-    return (x >= 0.0f) ? (1.0f - w) : w;
+static theta_type normal_cdf(theta_type x) {
+#pragma HLS INLINE
+    return bs_math_t::cdf(x);
 }
 
 // ---------------------------------------------------------------------
 // Black–Scholes pricing 
 // ---------------------------------------------------------------------
-static const theta_type invK     = 1.0f / K;
-static const theta_type sqrtT    = std::sqrt(T);
-static const theta_type inv_sqrtT = 1.0f / sqrtT;
+// Derived from K, r, v, T; recomputed by bs_set_params, never per price
+static theta_type invK      = 1.0f / K;
+static theta_type sqrtT     = std::sqrt(T);
+static theta_type inv_sqrtT = 1.0f / sqrtT;
 
-static const theta_type sigma      = v;
-static const theta_type sigma_sq   = v * v;
-static const theta_type denom      = sigma * sqrtT;
-static const theta_type inv_denom  = 1.0f / denom;
+static theta_type sigma      = v;
+static theta_type sigma_sq   = v * v;
+static theta_type denom      = sigma * sqrtT;
+static theta_type inv_denom  = 1.0f / denom;
+static theta_type discount   = std::exp(-r * T);
 
 void black_scholes_price(theta_type S_in, result_type &result) {
 #pragma HLS INLINE
@@ -64,7 +65,7 @@ void black_scholes_price(theta_type S_in, result_type &result) {
   }
 
   theta_type S_over_K = S_in * invK;
-  theta_type log_S_over_K = std::log(S_over_K);
+  theta_type log_S_over_K = bs_math_t::log(S_over_K);
   theta_type num_tmp = (r + 0.5f * sigma_sq);
   theta_type numerator   = log_S_over_K + num_tmp * T;
 
@@ -72,12 +73,11 @@ void black_scholes_price(theta_type S_in, result_type &result) {
   theta_type d2_tmp = sigma * sqrtT;
   theta_type d2 = d1 - d2_tmp;
 
+  // N(-x) = 1 - N(x)
   theta_type Nd1       = normal_cdf(d1);
   theta_type Nd2       = normal_cdf(d2);
-  theta_type Nminus_d1 = normal_cdf(-d1);
-  theta_type Nminus_d2 = normal_cdf(-d2);
-
-  theta_type discount = std::exp(-r * T);
+  theta_type Nminus_d1 = 1.0f - Nd1;
+  theta_type Nminus_d2 = 1.0f - Nd2;
 
   theta_type call_tmp1 = S_in * Nd1;
   theta_type call_tmp2 = K * discount;
@@ -90,6 +90,786 @@ void black_scholes_price(theta_type S_in, result_type &result) {
   result.put  = put_tmp2 - put_tmp3;
 }
 
+// Price of one contract from d1 and d2, with sgn = 1 for a call and -1 for
+// a put (the call formula on mirrored arguments):
+//   price = sgn * (S N(sgn d1) - K e^{-rT} N(sgn d2))
+// N1 = N(sgn d1), N2 = N(sgn d2) and the density at d1 are returned for the
+// Greeks.
+static theta_type bs_kernel(theta_type S, theta_type KD, theta_type d1, theta_type d2,
+                            theta_type sgn, theta_type &N1, theta_type &N2, theta_type &pdf_d1) {
+#pragma HLS INLINE
+  N1 = normal_cdf(sgn * d1, pdf_d1);
+  N2 = normal_cdf(sgn * d2);
+  return sgn * (S * N1 - KD * N2);
+}
+
+// ---------------------------------------------------------------------
+// Option chain
+// ---------------------------------------------------------------------
+// Terms of a contract that do not depend on the spot, computed at load time
+struct ChainEntry {
+  theta_type K_c;        // strike and maturity as loaded, to rederive the
+  theta_type T_c;        // rest when the parameters or the clock change
+  theta_type logK;       // log(K)
+  theta_type drift;      // (r + v^2 / 2) * T
+  theta_type vsqrtT;     // v * sqrt(T)
+  theta_type inv_denom;  // 1 / (v * sqrt(T))
+  theta_type KD;         // K * exp(-r * T)
+  theta_type sqrtT;      // sqrt(T), for vega
+  theta_type decay;      // v / (2 * sqrt(T)), for theta
+  theta_type rKD;        // r * K * exp(-r * T), for theta
+  theta_type TKD;        // T * K * exp(-r * T), for rho
+  bit8_t     type;
+  bool       valid;
+};
+
+/**
+ * Terms that change with the parameters or the time left: priced age years
+ * after it was loaded. logK is left as it is.
+ */
+static void chain_retime(ChainEntry &c, theta_type age) {
+#pragma HLS INLINE
+  theta_type T_left = c.T_c - age;
+  c.valid = (c.K_c > 0 && T_left > 0 && v > 0);
+  theta_type sqrtT_c = c.valid ? std::sqrt(T_left) : 1.0f;
+  c.drift     = (r + 0.5f * sigma_sq) * T_left;
+  c.vsqrtT    = sigma * sqrtT_c;
+  c.inv_denom = c.valid ? 1.0f / c.vsqrtT : 0.0f;
+  c.KD        = c.K_c * std::exp(-r * T_left);
+  c.sqrtT     = sqrtT_c;
+  c.decay     = 0.5f * sigma / sqrtT_c;
+  c.rKD       = r * c.KD;
+  c.TKD       = T_left * c.KD;
+}
+
+// The contract as loaded
+static ChainEntry chain_entry(theta_type K_c, theta_type T_c, bit8_t type) {
+  ChainEntry c;
+  c.K_c  = K_c;
+  c.T_c  = T_c;
+  c.logK = (K_c > 0) ? std::log(K_c) : 0.0f;
+  c.type = type;
+  chain_retime(c, 0.0f);
+  return c;
+}
+
+static ChainEntry chain[CHAIN_MAX] = {
+  chain_entry(K, T, OPTION_CALL),
+  chain_entry(K, T, OPTION_PUT),
+};
+static int  chain_count  = 2;
+static bool chain_greeks = false;
+static bool chain_loaded = false;   // false: the default chain, which follows K and T
+
+// Quantity held of each contract (see position_load)
+static int  position[CHAIN_MAX];
+static bool risk_on = false;
+
+static void price_cache_invalidate();
+
+void chain_load(hls::stream<bit32_t> &strm_in, int n, bool greeks) {
+  int kept = 0;
+  CHAIN_LOAD: for (int i = 0; i < n; i++) {
+  #pragma HLS LOOP_TRIPCOUNT min=1 max=CHAIN_MAX
+    theta_type K_c  = bits_to_float(strm_in.read());
+    theta_type T_c  = bits_to_float(strm_in.read());
+    bit8_t     type = (bit8_t)strm_in.read();
+    if (kept < CHAIN_MAX) chain[kept++] = chain_entry(K_c, T_c, type);
+  }
+  POSITION_CLEAR: for (int i = 0; i < CHAIN_MAX; i++) {
+    position[i] = 0;
+  }
+  chain_count  = kept;
+  chain_greeks = greeks;
+  chain_loaded = true;
+  chain_ns     = feed_ns;
+  price_cache_invalidate();
+}
+
+int chain_size() {
+#pragma HLS INLINE
+  return chain_count;
+}
+
+int chain_words() {
+#pragma HLS INLINE
+  return chain_greeks ? CHAIN_GREEK_WORDS : 1;
+}
+
+void position_set(int contract, int quantity) {
+  if (contract < 0 || contract >= chain_count) return;
+  position[contract] = quantity;
+  risk_on = true;
+  price_cache_invalidate();
+}
+
+void position_load(hls::stream<bit32_t> &strm_in, int n) {
+  bool landed = false;
+  POSITION_LOAD: for (int i = 0; i < n; i++) {
+  #pragma HLS LOOP_TRIPCOUNT min=1 max=CHAIN_MAX
+    bit32_t contract = strm_in.read();
+    bit32_t quantity = strm_in.read();
+    if (contract < (unsigned)chain_count) {
+      position[contract] = (int)(ap_int<32>)quantity;
+      landed = true;
+    }
+  }
+  if (!landed) return;
+  risk_on = true;
+  price_cache_invalidate();
+}
+
+int risk_words() {
+#pragma HLS INLINE
+  return risk_on ? RISK_WORDS : 0;
+}
+
+// Price and Greeks of one contract, zero when it cannot be priced
+struct ContractQuote {
+  theta_type price, delta, gamma, vega, theta, rho;
+};
+
+static ContractQuote chain_quote(const ChainEntry &c, bool spot_ok, theta_type S_in,
+                                 theta_type logS, theta_type invS) {
+#pragma HLS INLINE
+  bool       ok  = spot_ok && c.valid;
+  theta_type d1  = (logS - c.logK + c.drift) * c.inv_denom;
+  theta_type d2  = d1 - c.vsqrtT;
+  theta_type sgn = (c.type == OPTION_PUT) ? -1.0f : 1.0f;
+
+  theta_type N1, N2, pdf_d1;
+  theta_type price = bs_kernel(S_in, c.KD, d1, d2, sgn, N1, N2, pdf_d1);
+  theta_type S_pdf = S_in * pdf_d1;
+
+  ContractQuote q;
+  q.price = ok ? price : 0.0f;
+  q.delta = ok ? sgn * N1 : 0.0f;
+  q.gamma = ok ? pdf_d1 * invS * c.inv_denom : 0.0f;
+  q.vega  = ok ? S_pdf * c.sqrtT : 0.0f;
+  q.theta = ok ? -S_pdf * c.decay - sgn * c.rKD * N2 : 0.0f;
+  q.rho   = ok ? sgn * c.TKD * N2 : 0.0f;
+  return q;
+}
+
+/**
+ * log(S) and 1/S are the only spot terms, so they are taken once per
+ * update; each contract then costs a multiply-add for d1 and two CDFs
+ * (bs_kernel). The Greeks reuse the same CDFs and the density at d1 that the CDF
+ * approximation already evaluates, so they cost a few multiplies more.
+ *
+ * Without Greeks a contract is one stream word and CHAIN_PRICE runs at
+ * II=1. With them it is CHAIN_GREEK_WORDS words on the same 32-bit stream,
+ * so CHAIN_GREEKS is a separate loop at II=CHAIN_GREEK_WORDS rather than
+ * holding the price-only loop to that rate.
+ *
+ * The portfolio sums are accumulated in the same loops. A float add takes
+ * several cycles, so contract i goes to partial sum i % RISK_LANES, which
+ * was last written RISK_LANES contracts back, and CHAIN_PRICE keeps II=1;
+ * the lanes are added up once after it.
+ */
+void chain_price(theta_type S_in, hls::stream<bit32_t> &strm_out) {
+  bool       spot_ok = S_in > 0;
+  theta_type logS    = spot_ok ? bs_math_t::log(S_in) : 0.0f;
+  theta_type invS    = spot_ok ? 1.0f / S_in : 0.0f;
+
+  theta_type value_acc[RISK_LANES], delta_acc[RISK_LANES], gamma_acc[RISK_LANES];
+#pragma hls array_partition variable=value_acc complete
+#pragma hls array_partition variable=delta_acc complete
+#pragma hls array_partition variable=gamma_acc complete
+  RISK_INIT: for (int l = 0; l < RISK_LANES; l++) {
+  #pragma HLS UNROLL
+    value_acc[l] = 0.0f;
+    delta_acc[l] = 0.0f;
+    gamma_acc[l] = 0.0f;
+  }
+
+  if (chain_greeks) {
+    CHAIN_GREEKS: for (int i = 0; i < chain_count; i++) {
+    #pragma HLS PIPELINE II=CHAIN_GREEK_WORDS
+    #pragma HLS LOOP_TRIPCOUNT min=1 max=CHAIN_MAX
+      ContractQuote q    = chain_quote(chain[i], spot_ok, S_in, logS, invS);
+      theta_type    held = (theta_type)position[i];
+      int           lane = i % RISK_LANES;
+      strm_out.write(float_to_bits(q.price));
+      strm_out.write(float_to_bits(q.delta));
+      strm_out.write(float_to_bits(q.gamma));
+      strm_out.write(float_to_bits(q.vega));
+      strm_out.write(float_to_bits(q.theta));
+      strm_out.write(float_to_bits(q.rho));
+      value_acc[lane] += held * q.price;
+      delta_acc[lane] += held * q.delta;
+      gamma_acc[lane] += held * q.gamma;
+    }
+  } else {
+    CHAIN_PRICE: for (int i = 0; i < chain_count; i++) {
+    #pragma HLS PIPELINE II=1
+    #pragma HLS LOOP_TRIPCOUNT min=1 max=CHAIN_MAX
+      ContractQuote q    = chain_quote(chain[i], spot_ok, S_in, logS, invS);
+      theta_type    held = (theta_type)position[i];
+      int           lane = i % RISK_LANES;
+      strm_out.write(float_to_bits(q.price));
+      value_acc[lane] += held * q.price;
+      delta_acc[lane] += held * q.delta;
+      gamma_acc[lane] += held * q.gamma;
+    }
+  }
+
+  if (!risk_on) return;
+  theta_type value = 0.0f, delta = 0.0f, gamma = 0.0f;
+  RISK_REDUCE: for (int l = 0; l < RISK_LANES; l++) {
+  #pragma HLS UNROLL
+    value += value_acc[l];
+    delta += delta_acc[l];
+    gamma += gamma_acc[l];
+  }
+  strm_out.write(float_to_bits(value));
+  strm_out.write(float_to_bits(delta));
+  strm_out.write(float_to_bits(gamma));
+}
+
+// ---------------------------------------------------------------------
+// Price cache
+// ---------------------------------------------------------------------
+// Tags and valid bits sit in registers and each line's words side by side,
+// so the lookup is one cycle and a hit streams the line out at a word per
+// cycle
+static bit32_t cache_tag[PRICE_CACHE_LINES];
+static bool    cache_valid[PRICE_CACHE_LINES];
+static bit32_t cache_words[PRICE_CACHE_LINES][PRICE_CACHE_WORDS];
+static int     cache_hits   = 0;
+static int     cache_misses = 0;
+
+static void price_cache_invalidate() {
+#pragma hls array_partition variable=cache_valid complete
+  PRICE_CACHE_CLEAR: for (int i = 0; i < PRICE_CACHE_LINES; i++) {
+  #pragma HLS UNROLL
+    cache_valid[i] = false;
+  }
+  cache_hits   = 0;
+  cache_misses = 0;
+}
+
+/**
+ * A miss prices the chain through a line-sized buffer and keeps the words
+ * in the line as they go out, so it costs one chain_price plus a cycle per
+ * word. No valid spot, or a chain too large for a line, goes straight to
+ * chain_price.
+ */
+void chain_price_cached(bit32_t spot_ticks, hls::stream<bit32_t> &strm_out) {
+#pragma hls array_partition variable=cache_tag complete
+#pragma hls array_partition variable=cache_valid complete
+#pragma hls array_partition variable=cache_words complete dim=2
+  theta_type S_in  = (float)spot_ticks / 10000.0f;
+  int        words = chain_count * chain_words() + risk_words();
+  if (spot_ticks == 0 || words > PRICE_CACHE_WORDS) {
+    chain_price(S_in, strm_out);
+    return;
+  }
+
+  int line = spot_ticks & (PRICE_CACHE_LINES - 1);
+  if (cache_valid[line] && cache_tag[line] == spot_ticks) {
+    cache_hits++;
+    PRICE_CACHE_HIT: for (int w = 0; w < words; w++) {
+    #pragma HLS PIPELINE II=1
+    #pragma HLS LOOP_TRIPCOUNT min=1 max=PRICE_CACHE_WORDS
+      strm_out.write(cache_words[line][w]);
+    }
+    return;
+  }
+
+  cache_misses++;
+  hls::stream<bit32_t> fill;
+  #pragma HLS STREAM variable=fill depth=PRICE_CACHE_WORDS
+  chain_price(S_in, fill);
+  PRICE_CACHE_FILL: for (int w = 0; w < words; w++) {
+  #pragma HLS PIPELINE II=1
+  #pragma HLS LOOP_TRIPCOUNT min=1 max=PRICE_CACHE_WORDS
+    bit32_t word = fill.read();
+    cache_words[line][w] = word;
+    strm_out.write(word);
+  }
+  cache_tag[line]   = spot_ticks;
+  cache_valid[line] = true;
+}
+
+void price_cache_stats(int &hits, int &misses) {
+  hits   = cache_hits;
+  misses = cache_misses;
+}
+
+// ---------------------------------------------------------------------
+// Fixed-point kernel
+// ---------------------------------------------------------------------
+#define LOG_SEGMENTS (1 << BS_LOG_BITS)
+#define CDF_SEGMENTS (1 << BS_CDF_BITS)
+
+typedef ap_ufixed<12 + BS_FX_FRAC, 12> fx_coef_t;   // 1 / (v sqrt(T)), up to 4096
+
+// Parameter terms of the fixed-point kernel, derived at load time
+struct FxParams {
+  fx_t       lnK;        // log(K in ticks)
+  fx_t       drift;      // (r + v^2 / 2) * T
+  fx_t       vsqrtT;     // v * sqrt(T)
+  fx_coef_t  inv_denom;  // 1 / (v * sqrt(T))
+  fx_price_t KD;         // K * exp(-r * T), in ticks
+  bool       valid;
+};
+
+static FxParams fx_params(theta_type K_p, theta_type r_p, theta_type v_p, theta_type T_p) {
+  FxParams p;
+  p.valid     = (K_p > 0 && v_p > 0 && T_p > 0);
+  double sqrtT_p = p.valid ? std::sqrt((double)T_p) : 1.0;
+  p.lnK       = p.valid ? std::log((double)K_p * 10000.0) : 0.0;
+  p.drift     = ((double)r_p + 0.5 * v_p * v_p) * T_p;
+  p.vsqrtT    = v_p * sqrtT_p;
+  p.inv_denom = p.valid ? 1.0 / (v_p * sqrtT_p) : 0.0;
+  p.KD        = (double)K_p * 10000.0 * std::exp(-(double)r_p * T_p);
+  return p;
+}
+
+static FxParams fxp       = fx_params(K, r, v, T);
+static bool     fxp_stale = false;   // fxp predates the last bs_derive_time
+
+// Table initializers; the tables are constant, so they synthesize to ROMs
+static void init_log_table(fx_t table[LOG_SEGMENTS + 1]) {
+  for (int i = 0; i <= LOG_SEGMENTS; i++)
+    table[i] = std::log(1.0 + (double)i / LOG_SEGMENTS);
+}
+
+static void init_cdf_table(fx_prob_t table[CDF_SEGMENTS + 1]) {
+  for (int i = 0; i <= CDF_SEGMENTS; i++)
+    table[i] = 0.5 * std::erfc(-((double)i * BS_CDF_RANGE / CDF_SEGMENTS) / std::sqrt(2.0));
+}
+
+/**
+ * log(n) for an integer n > 0: n = 2^e * m with m in [1, 2) from the
+ * leading one, then log(m) interpolated between table points.
+ */
+static fx_t fx_log(bit32_t n) {
+#pragma HLS INLINE
+  fx_t table[LOG_SEGMENTS + 1];
+  init_log_table(table);
+
+  ap_uint<5> e = 0;
+  FX_LOG_LEAD: for (int b = 0; b < 32; b++) {
+  #pragma HLS UNROLL
+    if (n[b]) e = b;
+  }
+  ap_uint<32> norm = n << (31 - e);                  // leading one at bit 31
+
+  ap_ufixed<31, BS_LOG_BITS> pos;                    // (m - 1) in segments
+  pos(30, 0) = norm(30, 0);
+  int                           idx  = pos.to_int();
+  ap_ufixed<31 - BS_LOG_BITS, 0> frac = pos;         // keeps the fraction
+
+  fx_t lo = table[idx];
+  fx_t hi = table[idx + 1];
+  const fx_t LN2 = 0.69314718055994530942;
+  return e * LN2 + lo + (hi - lo) * frac;
+}
+
+/**
+ * N(x): N(|x|) interpolated between table points on [0, BS_CDF_RANGE),
+ * 1 beyond, and N(-x) = 1 - N(x).
+ */
+static fx_prob_t fx_normal_cdf(fx_t x) {
+#pragma HLS INLINE
+  fx_prob_t table[CDF_SEGMENTS + 1];
+  init_cdf_table(table);
+
+  fx_t a = (x >= 0) ? x : fx_t(-x);
+  fx_prob_t N = 1;
+  if (a < BS_CDF_RANGE) {
+    ap_ufixed<BS_CDF_BITS + BS_FX_FRAC, BS_CDF_BITS> pos = a * (CDF_SEGMENTS / BS_CDF_RANGE);
+    int                       idx  = pos.to_int();
+    ap_ufixed<BS_FX_FRAC, 0>  frac = pos;            // keeps the fraction
+    fx_prob_t lo = table[idx];
+    fx_prob_t hi = table[idx + 1];
+    N = lo + (hi - lo) * frac;
+  }
+  return (x >= 0) ? N : fx_prob_t(1 - N);
+}
+
+/**
+ * Same formula as black_scholes_price. log(S/K) is log(ticks) - log(K
+ * ticks), so the spot is never converted, and the put comes from parity,
+ * put = call - S + K e^{-rT}, so only N(d1) and N(d2) are evaluated.
+ */
+void black_scholes_price_fixed(bit32_t spot_ticks, result_fixed_type &result) {
+#pragma HLS INLINE
+  if (fxp_stale) {
+    fxp       = fx_params(K, r, v, T);
+    fxp_stale = false;
+  }
+  if (spot_ticks == 0 || !fxp.valid) {
+    result.call = 0;
+    result.put  = 0;
+    return;
+  }
+
+  fx_t x  = fx_log(spot_ticks) - fxp.lnK;
+  fx_t d1 = (x + fxp.drift) * fxp.inv_denom;
+  fx_t d2 = d1 - fxp.vsqrtT;
+
+  fx_prob_t Nd1 = fx_normal_cdf(d1);
+  fx_prob_t Nd2 = fx_normal_cdf(d2);
+
+  fx_price_t S = spot_ticks;
+  result.call = S * Nd1 - fxp.KD * Nd2;
+  result.put  = result.call - S + fxp.KD;
+}
+
+// ---------------------------------------------------------------------
+// Implied volatility
+// ---------------------------------------------------------------------
+/**
+ * Solves price(sigma) = q.price by IV_ITERATIONS Halley steps on
+ *   f(sigma) = price(sigma) - q.price,  f' = vega,  f'' = vega d1 d2 / sigma
+ * each priced with bs_kernel. The price rises with sigma, so every step
+ * also narrows a bracket [lo, hi]; a step that leaves the bracket (or
+ * a vanishing vega) falls back to bisection. The loop is fully unrolled,
+ * so a quote takes a fixed number of cycles and quotes pipeline at II=1.
+ */
+theta_type implied_vol(const IVQuote &q) {
+#pragma HLS INLINE
+  if (q.S <= 0 || q.K <= 0 || q.T <= 0) return 0.0f;
+
+  theta_type sgn     = (q.type == OPTION_PUT) ? -1.0f : 1.0f;
+  theta_type sqrtT_q = std::sqrt(q.T);
+  theta_type KD      = q.K * bs_math_t::exp(-r * q.T);
+  theta_type logSK   = bs_math_t::log(q.S / q.K);
+
+  // No volatility gives a price at or below the discounted intrinsic value,
+  // or at or above S (call) / K e^{-rT} (put)
+  theta_type intrinsic = sgn * (q.S - KD);
+  theta_type upper     = (q.type == OPTION_PUT) ? KD : q.S;
+  if (q.price <= intrinsic || q.price <= 0 || q.price >= upper) return 0.0f;
+
+  // Corrado-Miller start, on the call price (puts through parity); close
+  // to the root whenever the forward is not far from the strike
+  theta_type lo    = IV_MIN;
+  theta_type hi    = IV_MAX;
+  theta_type call  = (q.type == OPTION_PUT) ? q.price + q.S - KD : q.price;
+  theta_type half  = 0.5f * (q.S - KD);
+  theta_type disc  = (call - half) * (call - half) - 0.31830989f * 4.0f * half * half;   // 1 / pi
+  theta_type sigma = 2.50662827f / ((q.S + KD) * sqrtT_q)                               // sqrt(2 pi)
+                   * (call - half + std::sqrt(disc > 0 ? disc : 0.0f));
+  if (sigma < lo || sigma > hi) sigma = 0.5f * (lo + hi);
+
+  IV_ITERATE: for (int it = 0; it < IV_ITERATIONS; it++) {
+  #pragma HLS UNROLL
+    theta_type vsqrtT = sigma * sqrtT_q;
+    theta_type d1     = (logSK + (r + 0.5f * sigma * sigma) * q.T) / vsqrtT;
+    theta_type d2     = d1 - vsqrtT;
+
+    theta_type N1, N2, pdf_d1;
+    theta_type diff = bs_kernel(q.S, KD, d1, d2, sgn, N1, N2, pdf_d1) - q.price;
+    theta_type vega = q.S * pdf_d1 * sqrtT_q;
+
+    if (diff > 0) hi = sigma;
+    else          lo = sigma;
+
+    theta_type step  = diff / vega;
+    theta_type denom = 1.0f - 0.5f * step * d1 * d2 / sigma;
+    theta_type next  = sigma - ((denom > 0.5f) ? step / denom : step);
+    sigma = (vega > 1e-6f && next >= lo && next <= hi) ? next : 0.5f * (lo + hi);
+  }
+  return sigma;
+}
+
+void implied_vol_batch(const IVQuote quotes[], theta_type vols[], int n) {
+  IV_BATCH: for (int i = 0; i < n; i++) {
+  #pragma HLS PIPELINE II=1
+    vols[i] = implied_vol(quotes[i]);
+  }
+}
+
+// ---------------------------------------------------------------------
+// American (CRR) pricing
+// ---------------------------------------------------------------------
+// Terms of the tree, derived at load time. With u = e^{v sqrt(dt)},
+// dt = T / CRR_STEPS, node j of level i has spot S u^{2j - i}, taken as
+// S leaf[j] rise[i] so that every node's spot is two roundings from exact.
+struct CrrParams {
+  theta_type leaf[CRR_STEPS + 1];   // u^{2j - CRR_STEPS}
+  theta_type rise[CRR_STEPS + 1];   // u^{CRR_STEPS - i}
+  theta_type qu;                    // e^{-r dt} p, p the risk-neutral up probability
+  theta_type qd;                    // e^{-r dt} (1 - p)
+  bool       valid;
+};
+
+static CrrParams crr_params(theta_type K_p, theta_type r_p, theta_type v_p, theta_type T_p) {
+  CrrParams c;
+  double dt = (double)T_p / CRR_STEPS;
+  double u  = std::exp((double)v_p * std::sqrt(dt > 0 ? dt : 0.0));
+  double p  = (std::exp((double)r_p * dt) - 1.0 / u) / (u - 1.0 / u);
+  c.valid   = (K_p > 0 && v_p > 0 && T_p > 0 && p > 0 && p < 1);
+  CRR_POWERS: for (int k = 0; k <= CRR_STEPS; k++) {
+    c.leaf[k] = std::pow(u, 2 * k - CRR_STEPS);
+    c.rise[k] = std::pow(u, CRR_STEPS - k);
+  }
+  c.qu      = std::exp(-(double)r_p * dt) * p;
+  c.qd      = std::exp(-(double)r_p * dt) * (1.0 - p);
+  return c;
+}
+
+static CrrParams crr       = crr_params(K, r, v, T);
+static bool      crr_stale = false;   // crr predates the last bs_derive_time
+
+/**
+ * Backward induction, in place: node j of a level needs nodes j and j + 1
+ * of the level after it. In hardware CRR_UNROLL processing elements take a
+ * chunk of as many nodes per cycle, the arrays split cyclically so each
+ * element has its own bank. A level is swept from its top chunk down, and
+ * the chunk's top node reads the old value of the node above it, which the
+ * chunk before read and kept, so every bank is read and written once per
+ * cycle. A level of i + 1 nodes is ceil((i + 1) / CRR_UNROLL) cycles plus
+ * the pipeline depth, about CRR_STEPS^2 / (2 CRR_UNROLL) + CRR_STEPS *
+ * depth cycles a price. In software the chunks are plain loops over one
+ * cache-resident array per option type.
+ */
+void crr_american_price(theta_type S_in, result_type &result) {
+  if (crr_stale) {
+    crr       = crr_params(K, r, v, T);
+    crr_stale = false;
+  }
+  if (S_in <= 0 || !crr.valid) {
+    result.call = 0.0f;
+    result.put  = 0.0f;
+    return;
+  }
+
+  theta_type spot[CRR_STEPS + 1];
+  theta_type call[CRR_STEPS + 1];
+  theta_type put[CRR_STEPS + 1];
+#pragma hls array_partition variable=spot cyclic factor=CRR_UNROLL
+#pragma hls array_partition variable=call cyclic factor=CRR_UNROLL
+#pragma hls array_partition variable=put cyclic factor=CRR_UNROLL
+
+  // Payoffs at expiry
+  CRR_LEAVES: for (int j = 0; j <= CRR_STEPS; j++) {
+  #pragma HLS PIPELINE II=1
+  #pragma HLS UNROLL factor=CRR_UNROLL
+    theta_type s  = S_in * crr.leaf[j];
+    theta_type ex = s - K;
+    spot[j] = s;
+    call[j] = (ex > 0) ? ex : 0.0f;
+    put[j]  = (ex < 0) ? -ex : 0.0f;
+  }
+
+  // Level i has nodes 0..i; the rest of the array is idle
+  CRR_LEVELS: for (int i = CRR_STEPS - 1; i >= 0; i--) {
+    theta_type rise = crr.rise[i];
+    int        top  = i / CRR_UNROLL;
+    theta_type up_c = call[(top + 1) * CRR_UNROLL];   // node above the chunk, old value
+    theta_type up_p = put[(top + 1) * CRR_UNROLL];
+    CRR_CHUNKS: for (int c = top; c >= 0; c--) {
+    #pragma HLS PIPELINE II=1
+    #pragma HLS LOOP_TRIPCOUNT min=1 max=CRR_STEPS/CRR_UNROLL
+    #pragma HLS DEPENDENCE variable=call inter false
+    #pragma HLS DEPENDENCE variable=put inter false
+      theta_type old_c[CRR_UNROLL + 1];
+      theta_type old_p[CRR_UNROLL + 1];
+      CRR_READ: for (int k = 0; k < CRR_UNROLL; k++) {
+        old_c[k] = call[c * CRR_UNROLL + k];
+        old_p[k] = put[c * CRR_UNROLL + k];
+      }
+      old_c[CRR_UNROLL] = up_c;
+      old_p[CRR_UNROLL] = up_p;
+
+      CRR_NODES: for (int k = 0; k < CRR_UNROLL; k++) {
+        int j = c * CRR_UNROLL + k;
+        if (j <= i) {
+          theta_type ex     = spot[j] * rise - K;
+          theta_type hold_c = crr.qu * old_c[k + 1] + crr.qd * old_c[k];
+          theta_type hold_p = crr.qu * old_p[k + 1] + crr.qd * old_p[k];
+          call[j] = (ex > hold_c) ? ex : hold_c;
+          put[j]  = (-ex > hold_p) ? -ex : hold_p;
+        }
+      }
+      up_c = old_c[0];
+      up_p = old_p[0];
+    }
+  }
+
+  result.call = call[0];
+  result.put  = put[0];
+}
+
+// The BS_MODEL price of the single option
+static void option_price(theta_type S_in, result_type &result) {
+#pragma HLS INLINE
+#if BS_MODEL == BS_MODEL_AMERICAN
+  crr_american_price(S_in, result);
+#else
+  black_scholes_price(S_in, result);
+#endif
+}
+
+// ---------------------------------------------------------------------
+// Runtime parameters
+// ---------------------------------------------------------------------
+// Feed time in years
+static theta_type ns_to_years(bit64_t ns) {
+#pragma HLS INLINE
+  return (float)(uint64_t)ns * (float)(1.0 / BS_NS_PER_YEAR);
+}
+
+// Time left to the expiry at the last refresh
+static theta_type clock_T() {
+#pragma HLS INLINE
+  return (expiry_ns > clock_ns) ? ns_to_years(expiry_ns - clock_ns) : 0.0f;
+}
+
+/**
+ * Terms that depend on T, the only one the clock moves: the single-option
+ * constants and the chain's time-dependent terms (logK is kept). The tree
+ * is rebuilt here only when BS_MODEL prices with it, and the fixed-point
+ * terms never; otherwise they are rebuilt on their kernel's next call.
+ * Cached prices are dropped. Updates priced before the call use the old
+ * terms, updates after it the new ones.
+ */
+static void bs_derive_time() {
+  sqrtT     = std::sqrt(T);
+  inv_sqrtT = 1.0f / sqrtT;
+  denom     = sigma * sqrtT;
+  inv_denom = 1.0f / denom;
+  discount  = std::exp(-r * T);
+  fxp_stale = true;
+#if BS_MODEL == BS_MODEL_AMERICAN
+  crr       = crr_params(K, r, v, T);
+#else
+  crr_stale = true;
+#endif
+
+  // The default chain follows T, which already counts the clock
+  theta_type age = (expiry_ns != 0 && clock_ns > chain_ns) ? ns_to_years(clock_ns - chain_ns) : 0.0f;
+  if (!chain_loaded) {
+    chain[0].T_c = T;
+    chain[1].T_c = T;
+    age = 0.0f;
+  }
+  CHAIN_RETIME: for (int i = 0; i < chain_count; i++) {
+  #pragma HLS PIPELINE II=1
+  #pragma HLS LOOP_TRIPCOUNT min=1 max=CHAIN_MAX
+    chain_retime(chain[i], age);
+  }
+  price_cache_invalidate();
+}
+
+/**
+ * Everything derived from K, r and v, then the time terms. The default
+ * chain follows K, so only its logK is rebuilt.
+ */
+static void bs_derive() {
+  invK     = 1.0f / K;
+  sigma    = v;
+  sigma_sq = v * v;
+  if (!chain_loaded) {
+    theta_type logK = (K > 0) ? std::log(K) : 0.0f;
+    chain[0].K_c = K;  chain[0].logK = logK;
+    chain[1].K_c = K;  chain[1].logK = logK;
+  }
+  bs_derive_time();
+}
+
+void bs_set_params(theta_type K_new, theta_type r_new, theta_type v_new, theta_type T_new) {
+  K       = K_new;
+  r       = r_new;
+  v       = v_new;
+  T_param = T_new;
+  T       = expiry_ns ? clock_T() : T_param;
+  bs_derive();
+}
+
+void bs_load_params(hls::stream<bit32_t> &strm_in) {
+  theta_type K_new = bits_to_float(strm_in.read());
+  theta_type r_new = bits_to_float(strm_in.read());
+  theta_type v_new = bits_to_float(strm_in.read());
+  theta_type T_new = bits_to_float(strm_in.read());
+  bs_set_params(K_new, r_new, v_new, T_new);
+}
+
+void bs_set_expiry(bit64_t expiry_new) {
+  expiry_ns = expiry_new;
+  T         = expiry_ns ? clock_T() : T_param;
+  bs_derive_time();
+}
+
+void bs_load_expiry(hls::stream<bit32_t> &strm_in) {
+  bit64_t expiry_new = 0;
+  expiry_new(63, 32) = strm_in.read();
+  expiry_new(31, 0)  = strm_in.read();
+  bs_set_expiry(expiry_new);
+}
+
+/**
+ * One compare per message; the sqrt and exp of a refresh are paid once
+ * per BS_CLOCK_REFRESH_NS of feed time, for the T terms only.
+ */
+void bs_clock(bit64_t now_ns) {
+  feed_ns = now_ns;
+  if (now_ns >= clock_ns && now_ns < clock_next) return;
+  clock_ns   = now_ns;
+  clock_next = now_ns + BS_CLOCK_REFRESH_NS;
+  if (expiry_ns == 0) return;
+  T = clock_T();
+  bs_derive_time();
+}
+
+// ---------------------------------------------------------------------
+// Realized volatility
+// ---------------------------------------------------------------------
+#define RV_TAU_NS (RV_HALFLIFE_NS / 0.69314718)   // decay time constant
+
+// Exponentially weighted realized variance. Over a gap dt both sums decay by
+// e^{-dt/tau}; the return just ended is then added at full weight, and the
+// span by the decayed weight of the gap, tau (1 - e^{-dt/tau}). sum_sq / span
+// is the variance per ns, unbiased from the first return on.
+struct RealizedVol {
+  bit32_t last;       // spot ticks of the previous observation, 0 for none
+  bit64_t last_ns;
+  float   sum_sq;     // decayed sum of squared log returns
+  float   span;       // decayed feed time they cover, ns
+};
+
+static RealizedVol rv          = { 0, 0, 0.0f, 0.0f };
+static bit64_t     vol_push_ns = 0;   // 0: never push
+static bit64_t     vol_next_ns = 0;
+
+/**
+ * The log return between two tick prices a and b is taken as
+ * 2 (a - b) / (a + b), exact to (a - b)^3: the difference is an exact
+ * integer, where log(a) - log(b) in float would lose the size of a tick.
+ */
+void bs_observe(bit32_t spot_ticks, bit64_t now_ns) {
+  if (spot_ticks == 0) return;
+  if (rv.last != 0 && now_ns >= rv.last_ns) {
+    float decay = bs_math_t::exp(-(float)(uint64_t)(now_ns - rv.last_ns) * (float)(1.0 / RV_TAU_NS));
+    float ret   = 2.0f * ((float)spot_ticks - (float)rv.last) / ((float)spot_ticks + (float)rv.last);
+    rv.sum_sq = rv.sum_sq * decay + ret * ret;
+    rv.span   = rv.span * decay + (float)RV_TAU_NS * (1.0f - decay);
+  }
+  rv.last    = spot_ticks;
+  rv.last_ns = now_ns;
+
+  theta_type estimate = bs_realized_vol();
+  if (vol_push_ns == 0 || estimate == 0 || now_ns < vol_next_ns) return;
+  vol_next_ns = now_ns + vol_push_ns;
+  v = (estimate < IV_MIN) ? IV_MIN : (estimate > IV_MAX) ? IV_MAX : estimate;
+  bs_derive();
+}
+
+void bs_set_vol_push(bit64_t period_ns) {
+  vol_push_ns = period_ns;
+  vol_next_ns = 0;
+}
+
+theta_type bs_realized_vol() {
+  if (rv.span < 0.5f * (float)RV_TAU_NS) return 0.0f;   // under a half-life
+  return std::sqrt(rv.sum_sq / rv.span * (float)BS_NS_PER_YEAR);
+}
+
 void bs_dut(hls::stream<bit32_t> &strm_in, hls::stream<bit32_t> &strm_out){
   #pragma HLS INLINE off
   #pragma HLS PIPELINE II=1
@@ -109,10 +889,10 @@ void bs_dut(hls::stream<bit32_t> &strm_in, hls::stream<bit32_t> &strm_out){
   theta_type S_in = u_in.fval;
 
   // ------------------------------------------------------
-  // Call Black–Scholes price
+  // Call the BS_MODEL pricer
   // ------------------------------------------------------
   result_type result;
-  black_scholes_price(S_in, result);
+  option_price(S_in, result);
 
   // ------------------------------------------------------
   // Output processing
@@ -141,9 +921,9 @@ result_type bs(bit32_t spot_price) {
     u_in.ival = static_cast<int>(spot_price);
     theta_type S_in = u_in.fval;
 
-    // Compute Black–Scholes price
+    // Compute the BS_MODEL price
     result_type result;
-    black_scholes_price(S_in, result);
+    option_price(S_in, result);
 
     return result;
 }
\ No newline at end of file
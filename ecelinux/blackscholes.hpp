@@ -7,8 +7,10 @@
 #define BLACKSCHOLES_HPP
 
 #include "typedefs.h"
+#include "approx.hpp"
 
 #include <hls_stream.h>
+#include <ap_fixed.h>
 
 #include <cmath>
 
@@ -20,18 +22,41 @@
 // Parameter type for Black–Scholes
 typedef float theta_type;
 
-// Global Black–Scholes parameters (strike, rate, volatility, maturity)
+// Global Black–Scholes parameters (strike, rate, volatility, maturity).
+// Read-only outside blackscholes.cpp: change them with bs_set_params, which
+// also updates everything derived from them.
 extern theta_type K;
 extern theta_type r;
 extern theta_type v;
 extern theta_type T;
 
+// log / exp / normal CDF used per price (see approx.hpp). Load-time terms
+// always use the std:: functions.
+#ifndef BS_MATH
+#define BS_MATH MathPoly<8>
+#endif
+typedef BS_MATH bs_math_t;
+
 // Result struct (call + put)
 struct result_type {
   theta_type call;
   theta_type put;
 };
 
+// Option chain: up to CHAIN_MAX contracts, all priced per spot update with
+// the global rate and volatility. A contract is loaded as CONTRACT_WORDS
+// words: float-encoded strike, float-encoded maturity (years), and its type.
+// Until a chain is loaded it holds a call and a put at the global K and T.
+#define CHAIN_MAX      256
+#define CONTRACT_WORDS 3
+#define OPTION_CALL    0
+#define OPTION_PUT     1
+
+// Per-contract output of a chain loaded with Greeks: the price, then delta,
+// gamma, vega (per unit of volatility), theta (per year) and rho (per unit
+// of rate), all float-encoded. Otherwise just the price.
+#define CHAIN_GREEK_WORDS 6
+
 // Helpers
 bit32_t float_to_bits(float x);
 float bits_to_float(bit32_t w);
@@ -42,9 +67,201 @@ void black_scholes_price(theta_type S_in, result_type &result);
 // Top function
 result_type bs(bit32_t spot_price);
 
+// Runtime parameter load. On the stream, PARAM_WORDS float-encoded words:
+// strike, rate, volatility, maturity (years).
+#define PARAM_WORDS 4
+void bs_set_params(theta_type K_new, theta_type r_new, theta_type v_new, theta_type T_new);
+void bs_load_params(hls::stream<bit32_t> &strm_in);
+
+// Time to expiry from the feed clock. With an expiry set (nanoseconds on the
+// ITCH clock, counted from midnight of the feed day, so an expiry days out is
+// past 86400e9), T is the time left to it in years of BS_NS_PER_YEAR and the
+// T of bs_set_params is ignored; a loaded chain's maturities shrink by the
+// feed time since it was loaded. bs_clock is given each message's
+// timestamp, and T, sqrt(T), e^{-rT} and the chain terms are refreshed on
+// the first message of every BS_CLOCK_REFRESH_NS of feed time (or when the
+// clock goes back), not per price. Expiry 0, the default, keeps T fixed.
+// On the stream, EXPIRY_WORDS words: the high, then the low 32 bits.
+#define EXPIRY_WORDS   2
+#define BS_NS_PER_YEAR 31536000000000000.0   // 365 days
+#ifndef BS_CLOCK_REFRESH_NS
+#define BS_CLOCK_REFRESH_NS 1000000000ULL
+#endif
+void bs_set_expiry(bit64_t expiry_ns);
+void bs_load_expiry(hls::stream<bit32_t> &strm_in);
+void bs_clock(bit64_t now_ns);
+
+// Realized volatility of the spot, from bs_observe with each new valid spot
+// (ticks) and its timestamp. The squared log returns are summed with a
+// weight that halves every RV_HALFLIFE_NS of feed time and divided by the
+// feed time they cover, decayed the same way, then annualized; the state is
+// a few registers, no history. 0 until the returns cover a half-life.
+// Once warm, and with a push period set, v is replaced by the estimate
+// (within [IV_MIN, IV_MAX]) at most once per period, overriding the v of
+// bs_set_params. Period 0, the default, never pushes.
+#ifndef RV_HALFLIFE_NS
+#define RV_HALFLIFE_NS 60000000000ULL   // 1 minute
+#endif
+void bs_observe(bit32_t spot_ticks, bit64_t now_ns);
+void bs_set_vol_push(bit64_t period_ns);
+theta_type bs_realized_vol();
+
+// Replace the chain with n contracts read from strm_in (contracts past
+// CHAIN_MAX are consumed and dropped), with or without Greeks
+void chain_load(hls::stream<bit32_t> &strm_in, int n, bool greeks);
+
+// Number of contracts in the chain, and output words per contract
+int chain_size();
+int chain_words();
+
+// Write chain_words() float-encoded words per contract to strm_out, in chain
+// order, then the risk_words() words of the portfolio (all 0 for a spot that
+// is not positive)
+void chain_price(theta_type S_in, hls::stream<bit32_t> &strm_out);
+
+// ---------------------------------------------------------------------
+// Portfolio risk
+// ---------------------------------------------------------------------
+// A signed quantity per chain contract, 0 until set. Once a position has been
+// set for a contract in the chain, every chain_price ends with RISK_WORDS
+// float-encoded words: the
+// portfolio value, delta and gamma, each the sum over the chain of quantity
+// times the contract's price, delta or gamma (per unit of the underlying).
+// On the stream, POSITION_WORDS words per update: the contract's index in the
+// chain, then its new quantity (two's complement); indices past the chain are
+// dropped and do not turn the risk words on. chain_load sets every quantity back to 0 and keeps the risk words.
+#define RISK_WORDS     3
+#define POSITION_WORDS 2
+#ifndef RISK_LANES
+#define RISK_LANES     8   // partial sums, at least the adder latency
+#endif
+void position_set(int contract, int quantity);
+void position_load(hls::stream<bit32_t> &strm_in, int n);
+int  risk_words();
+
+// ---------------------------------------------------------------------
+// Price cache
+// ---------------------------------------------------------------------
+// The spot moves among a handful of ticks around the mid, so chain outputs
+// are cached by spot ticks (1 tick = 1e-4): 2^PRICE_CACHE_BITS direct-mapped
+// lines indexed by the low bits of the ticks, so every tick of a window that
+// wide around the mid has its own line. A line holds up to
+// PRICE_CACHE_WORDS output words; a chain that writes more is priced on every
+// update. bs_set_params, chain_load and position updates invalidate every
+// line.
+#ifndef PRICE_CACHE_BITS
+#define PRICE_CACHE_BITS  6
+#endif
+#define PRICE_CACHE_LINES (1 << PRICE_CACHE_BITS)
+#define PRICE_CACHE_WORDS (2 * CHAIN_GREEK_WORDS + RISK_WORDS)   // the default chain with Greeks and risk
+
+// chain_price for a spot in ticks (0: no valid spot), from the cache on a
+// hit
+void chain_price_cached(bit32_t spot_ticks, hls::stream<bit32_t> &strm_out);
+
+// Hits and misses since the last invalidation (lookups that bypass the cache
+// count as neither)
+void price_cache_stats(int &hits, int &misses);
+
+// ---------------------------------------------------------------------
+// Fixed-point kernel
+// ---------------------------------------------------------------------
+// Prices the single option (global K, r, v, T) straight from the integer
+// tick spot of the book (1 tick = 1e-4), with fixed-point log and normal
+// CDF and no float conversion. Prices come back in ticks. The word lengths
+// and table sizes below can be overridden with -D; the accuracy report in
+// blackscholes_test shows the error a choice gives.
+#ifndef BS_FX_FRAC
+#define BS_FX_FRAC    24   // fraction bits of log-moneyness, d1 and d2
+#endif
+#ifndef BS_PROB_FRAC
+#define BS_PROB_FRAC  24   // fraction bits of N(d)
+#endif
+#ifndef BS_PRICE_FRAC
+#define BS_PRICE_FRAC 8    // fraction bits of prices, in ticks
+#endif
+#ifndef BS_LOG_BITS
+#define BS_LOG_BITS   8    // log: 2^BS_LOG_BITS linear segments over [1, 2)
+#endif
+#ifndef BS_CDF_BITS
+#define BS_CDF_BITS   10   // N: 2^BS_CDF_BITS linear segments over [0, BS_CDF_RANGE)
+#endif
+#define BS_CDF_RANGE  8    // N(x) is 1 to within 1e-15 beyond it
+
+typedef ap_fixed<8 + BS_FX_FRAC, 8, AP_TRN, AP_SAT> fx_t;        // |x| < 128
+typedef ap_ufixed<1 + BS_PROB_FRAC, 1>              fx_prob_t;   // [0, 1]
+typedef ap_fixed<34 + BS_PRICE_FRAC, 34>            fx_price_t;  // ticks
+
+struct result_fixed_type {
+  fx_price_t call;
+  fx_price_t put;
+};
+
+void black_scholes_price_fixed(bit32_t spot_ticks, result_fixed_type &result);
+
+// ---------------------------------------------------------------------
+// Implied volatility
+// ---------------------------------------------------------------------
+// Volatility that reproduces a quoted option price, at the global rate.
+// 0 when no volatility in [IV_MIN, IV_MAX] can (price outside the
+// no-arbitrage bounds). IV_ITERATIONS safeguarded Halley steps are run
+// (see implied_vol); 8 converge to float precision across the bracket.
+#ifndef IV_ITERATIONS
+#define IV_ITERATIONS 8
+#endif
+#define IV_MIN 0.001f
+#define IV_MAX 5.0f
+
+struct IVQuote {
+  theta_type S;        // spot
+  theta_type K;        // strike
+  theta_type T;        // maturity (years)
+  theta_type price;    // quoted option price
+  bit8_t     type;     // OPTION_CALL / OPTION_PUT
+};
+
+theta_type implied_vol(const IVQuote &q);
+
+// Batched form, one quote per cycle in hardware; plain C++ for the host
+void implied_vol_batch(const IVQuote quotes[], theta_type vols[], int n);
+
+// ---------------------------------------------------------------------
+// American (CRR) pricing
+// ---------------------------------------------------------------------
+// American call and put on the single option (global K, r, v, T) from a
+// Cox-Ross-Rubinstein binomial tree of CRR_STEPS steps: early exercise is
+// checked at every node. The discretization error falls as 1 / CRR_STEPS
+// (about a cent at 128 for a 200 strike, 1 year, 20% vol). Both are 0
+// when the tree has no risk-neutral probability (v sqrt(T / CRR_STEPS) at
+// or below r T / CRR_STEPS).
+// In hardware CRR_UNROLL nodes of a level are updated per cycle, each with
+// five float multipliers and three adders, about 21 DSP48s on a Zynq-7000
+// at the default cores: 4 takes about 105 of the Zedboard's 220 with the
+// leaves, 8 about 210, which leaves nothing for the rest of the design. It
+// must divide CRR_STEPS.
+#ifndef CRR_STEPS
+#define CRR_STEPS 128
+#endif
+#ifndef CRR_UNROLL
+#define CRR_UNROLL 4
+#endif
+#if CRR_STEPS % CRR_UNROLL != 0
+#error "CRR_UNROLL must divide CRR_STEPS"
+#endif
+void crr_american_price(theta_type S_in, result_type &result);
+
+// Model priced by bs() and bs_dut: black_scholes_price (European) or
+// crr_american_price
+#define BS_MODEL_EUROPEAN 0
+#define BS_MODEL_AMERICAN 1
+#ifndef BS_MODEL
+#define BS_MODEL BS_MODEL_EUROPEAN
+#endif
+
 // Black-Scholes HLS DUT:
 //   - strm_in:  1 x 32-bit word containing float-encoded spot price S
-//   - strm_out: 2 x 32-bit words containing float-encoded call, then put
+//   - strm_out: 2 x 32-bit words containing float-encoded call, then put,
+//               from the BS_MODEL model
 void bs_dut(hls::stream<bit32_t> &strm_in, hls::stream<bit32_t> &strm_out);
 
 #endif // BLACKSCHOLES_HPP
@@ -1,7 +1,95 @@
 #include "blackscholes.hpp"
 
+#include <random>
+#include <vector>
+
 static const char* INPUT_ITCH_FILE = "data/bs_15.dat";
 
+// Closed-form reference for one contract, in double precision: the price,
+// then delta, gamma, vega, theta, rho (the CHAIN_GREEK_WORDS layout)
+static void bs_reference(double S, double K_c, double T_c, int type, double out[CHAIN_GREEK_WORDS],
+                         double vol = v) {
+    double sqrtT = std::sqrt(T_c);
+    double d1  = (std::log(S / K_c) + (r + 0.5 * vol * vol) * T_c) / (vol * sqrtT);
+    double d2  = d1 - vol * sqrtT;
+    double KD  = K_c * std::exp(-r * T_c);
+    double sgn = (type == OPTION_PUT) ? -1.0 : 1.0;
+    double N1  = 0.5 * std::erfc(-sgn * d1 / std::sqrt(2.0));
+    double N2  = 0.5 * std::erfc(-sgn * d2 / std::sqrt(2.0));
+    double pdf = std::exp(-0.5 * d1 * d1) / std::sqrt(2.0 * M_PI);
+    out[0] = sgn * (S * N1 - KD * N2);
+    out[1] = sgn * N1;
+    out[2] = pdf / (S * vol * sqrtT);
+    out[3] = S * pdf * sqrtT;
+    out[4] = -S * pdf * vol / (2.0 * sqrtT) - sgn * r * KD * N2;
+    out[5] = sgn * T_c * KD * N2;
+}
+
+// American call and put from a CRR tree of n steps in double precision, at
+// the global r and v
+static void crr_reference(double S, double K_c, double T_c, int n, double& call, double& put) {
+    double dt = T_c / n;
+    double u  = std::exp(v * std::sqrt(dt));
+    double p  = (std::exp(r * dt) - 1.0 / u) / (u - 1.0 / u);
+    double df = std::exp(-r * dt);
+    std::vector<double> c(n + 1), q(n + 1);
+    for (int j = 0; j <= n; j++) {
+        double s = S * std::pow(u, 2 * j - n);
+        c[j] = std::max(s - K_c, 0.0);
+        q[j] = std::max(K_c - s, 0.0);
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        for (int j = 0; j <= i; j++) {
+            double s = S * std::pow(u, 2 * j - i);
+            c[j] = std::max(s - K_c, df * (p * c[j + 1] + (1 - p) * c[j]));
+            q[j] = std::max(K_c - s, df * (p * q[j + 1] + (1 - p) * q[j]));
+        }
+    }
+    call = c[0];
+    put  = q[0];
+}
+
+// Words of chain_price_cached that differ from chain_price at a spot in
+// ticks
+static int cache_mismatches(uint32_t ticks) {
+    hls::stream<bit32_t> cached, direct;
+    chain_price_cached(ticks, cached);
+    chain_price(ticks / 10000.0f, direct);
+    int mismatches = 0;
+    while (!direct.empty()) {
+        if (cached.empty() || cached.read() != direct.read()) mismatches++;
+    }
+    return mismatches + (cached.empty() ? 0 : 1);
+}
+
+// Max error of a math policy (approx.hpp) against double precision: log
+// (absolute) over [0.01, 1000], exp (relative) over [-20, 20], cdf
+// (absolute) over [-10, 10]
+struct MathError {
+    double log, exp, cdf;
+};
+
+template<class M>
+static MathError math_error() {
+    MathError e = { 0, 0, 0 };
+    const int POINTS = 4000;
+    BS_TEST_MATH: for (int i = 0; i <= POINTS; i++) {
+        double t = (double)i / POINTS;
+        float  xl = (float)std::pow(10.0, -2.0 + 5.0 * t);
+        float  xe = (float)(-20.0 + 40.0 * t);
+        float  xc = (float)(-10.0 + 20.0 * t);
+        e.log = std::max(e.log, std::fabs(M::log(xl) - std::log((double)xl)));
+        e.exp = std::max(e.exp, std::fabs(M::exp(xe) / std::exp((double)xe) - 1.0));
+        e.cdf = std::max(e.cdf, std::fabs(M::cdf(xc) - 0.5 * std::erfc(-xc / std::sqrt(2.0))));
+    }
+    return e;
+}
+
+static void print_math_error(const char* name, const MathError& e) {
+    std::cout << std::left << std::setw(22) << name << ": log " << e.log
+              << "  exp " << e.exp << "  cdf " << e.cdf << "\n";
+}
+
 int main() {
 
     // --------------------------------------------------------------
@@ -87,16 +175,403 @@ int main() {
             << "\n";
     }
 
+    // Option chain: strikes around the money at three maturities, both types
+    const int   CHAIN_N = 12;
+    const float chain_K[4] = { 180.0f, 195.0f, 205.0f, 220.0f };
+    const float chain_T[3] = { 0.25f, 1.0f, 2.0f };
+    const float chain_S[3] = { 185.0f, 200.0f, 230.0f };
+
+    // Loaded twice: prices only, then prices and Greeks
+    const char* greek_name[CHAIN_GREEK_WORDS] = { "Price", "Delta", "Gamma", "Vega", "Theta", "Rho" };
+    int chain_errors = 0;
+    BS_TEST_CHAIN_PASS: for (int greeks = 0; greeks < 2; greeks++) {
+        hls::stream<bit32_t> chain_stream;
+        BS_TEST_CHAIN_LOAD: for (int c = 0; c < CHAIN_N; c++) {
+            chain_stream.write(float_to_bits(chain_K[c % 4]));
+            chain_stream.write(float_to_bits(chain_T[c % 3]));
+            chain_stream.write((c & 1) ? OPTION_PUT : OPTION_CALL);
+        }
+        chain_load(chain_stream, CHAIN_N, greeks);
+        if (chain_size() != CHAIN_N) chain_errors++;
+
+        std::cout << "\n-- Option chain (" << chain_size() << " contracts"
+                  << (greeks ? ", Greeks" : "") << ") --\n";
+        BS_TEST_CHAIN: for (int i = 0; i < 3; i++) {
+            chain_price(chain_S[i], out_stream);
+            for (int c = 0; c < CHAIN_N; c++) {
+                double exp[CHAIN_GREEK_WORDS];
+                bs_reference(chain_S[i], chain_K[c % 4], chain_T[c % 3], (c & 1) ? OPTION_PUT : OPTION_CALL, exp);
+                std::cout << "S=" << std::left << std::setw(6) << chain_S[i]
+                          << " | K=" << std::setw(6) << chain_K[c % 4]
+                          << " T=" << std::setw(5) << chain_T[c % 3]
+                          << ((c & 1) ? " Put " : " Call");
+                bool pass = true;
+                for (int w = 0; w < chain_words(); w++) {
+                    float hw = bits_to_float(out_stream.read());
+                    // Same bound as above for the price, relative for the Greeks
+                    double tol = (w == 0) ? 0.01 : 1e-3 * std::fabs(exp[w]) + 1e-5;
+                    pass &= std::fabs(hw - exp[w]) < tol;
+                    std::cout << " | " << greek_name[w] << "=" << std::setprecision(4) << hw
+                              << " Exp=" << exp[w] << std::setprecision(2);
+                }
+                if (!pass) chain_errors++;
+                std::cout << " | Status=" << (pass ? "PASS" : "FAIL") << "\n";
+            }
+        }
+    }
+    errors += chain_errors;
+
+    // Runtime parameters: the single option and the chain both reprice
+    // with the new K, r, v, T
+    const int   PARAM_N = 3;
+    const float param_S[PARAM_N] = { 150.0f, 180.0f, 210.0f };
+    hls::stream<bit32_t> param_stream;
+    param_stream.write(float_to_bits(180.0f));
+    param_stream.write(float_to_bits(0.03f));
+    param_stream.write(float_to_bits(0.35f));
+    param_stream.write(float_to_bits(0.5f));
+    bs_load_params(param_stream);
+
+    std::cout << "\n-- Runtime parameters (K=" << K << " r=" << r << " v=" << v << " T=" << T << ") --\n";
+    BS_TEST_PARAMS: for (int i = 0; i < PARAM_N; i++) {
+        in_stream.write(float_to_bits(param_S[i]));
+        bs_dut(in_stream, out_stream);
+        float call_hw = bits_to_float(out_stream.read());
+        float put_hw  = bits_to_float(out_stream.read());
+
+        chain_price(param_S[i], out_stream);
+        float chain_hw = bits_to_float(out_stream.read());   // contract 0: K=180, T=0.25 call
+        while (!out_stream.empty()) out_stream.read();
+
+        double call_exp[CHAIN_GREEK_WORDS], put_exp[CHAIN_GREEK_WORDS], chain_exp[CHAIN_GREEK_WORDS];
+        bs_reference(param_S[i], K, T, OPTION_CALL, call_exp);
+        bs_reference(param_S[i], K, T, OPTION_PUT,  put_exp);
+        bs_reference(param_S[i], chain_K[0], chain_T[0], OPTION_CALL, chain_exp);
+
+        bool pass = std::fabs(call_hw - call_exp[0]) < 0.01 &&
+                    std::fabs(put_hw  - put_exp[0])  < 0.01 &&
+                    std::fabs(chain_hw - chain_exp[0]) < 0.01;
+        if (!pass) errors++;
+        std::cout << "S=" << std::left << std::setw(6) << param_S[i]
+                  << " | Call_HW=" << std::setw(7) << call_hw << " Exp=" << std::setw(7) << call_exp[0]
+                  << " | Put_HW="  << std::setw(7) << put_hw  << " Exp=" << std::setw(7) << put_exp[0]
+                  << " | Chain_HW=" << std::setw(7) << chain_hw << " Exp=" << std::setw(7) << chain_exp[0]
+                  << " | Status=" << (pass ? "PASS" : "FAIL") << "\n";
+    }
+
+    // Accuracy report: the float and fixed-point kernels against the double
+    // reference over a spot / strike / volatility grid. Relative error is
+    // taken over prices of at least a cent.
+    const int   GRID_K = 5, GRID_V = 4, GRID_S = 71;
+    const float grid_K[GRID_K] = { 100.0f, 150.0f, 200.0f, 250.0f, 300.0f };
+    const float grid_V[GRID_V] = { 0.1f, 0.2f, 0.4f, 0.8f };
+    double float_abs = 0, float_rel = 0, fixed_abs = 0, fixed_rel = 0;
+    BS_TEST_GRID_K: for (int k = 0; k < GRID_K; k++) {
+        BS_TEST_GRID_V: for (int j = 0; j < GRID_V; j++) {
+            bs_set_params(grid_K[k], 0.05f, grid_V[j], 1.0f);
+            BS_TEST_GRID_S: for (int i = 0; i < GRID_S; i++) {
+                uint32_t spot_ticks = (uint32_t)(50 + 5 * i) * 10000;
+                double   S = spot_ticks / 10000.0;
+
+                result_type       res_float;
+                result_fixed_type res_fixed;
+                black_scholes_price((float)S, res_float);
+                black_scholes_price_fixed(spot_ticks, res_fixed);
+
+                double call_exp[CHAIN_GREEK_WORDS], put_exp[CHAIN_GREEK_WORDS];
+                bs_reference(S, K, T, OPTION_CALL, call_exp);
+                bs_reference(S, K, T, OPTION_PUT,  put_exp);
+
+                double got[4] = { res_float.call, res_float.put,
+                                  res_fixed.call.to_double() / 10000.0, res_fixed.put.to_double() / 10000.0 };
+                double exp[4] = { call_exp[0], put_exp[0], call_exp[0], put_exp[0] };
+                for (int q = 0; q < 4; q++) {
+                    double abs_err = std::fabs(got[q] - exp[q]);
+                    double rel_err = (exp[q] >= 0.01) ? abs_err / exp[q] : 0.0;
+                    double& max_abs = (q < 2) ? float_abs : fixed_abs;
+                    double& max_rel = (q < 2) ? float_rel : fixed_rel;
+                    max_abs = std::max(max_abs, abs_err);
+                    max_rel = std::max(max_rel, rel_err);
+                }
+            }
+        }
+    }
+    bool fixed_pass = fixed_abs < 0.01;
+    if (!fixed_pass) errors++;
+
+    std::cout << "\n-- Accuracy (" << GRID_K * GRID_V * GRID_S << " spot/strike/vol points) --\n";
+    std::cout << std::scientific << std::setprecision(3);
+    print_math_error("MathLibm",      math_error<MathLibm>());
+    print_math_error("MathTable<8>",  math_error<MathTable<8> >());
+    print_math_error("MathTable<10>", math_error<MathTable<10> >());
+    print_math_error("MathPoly<6>",   math_error<MathPoly<6> >());
+    print_math_error("MathPoly<8>",   math_error<MathPoly<8> >());
+    MathError bs_math = math_error<bs_math_t>();
+    bool math_pass = bs_math.cdf < 1e-5 && bs_math.log < 1e-5 && bs_math.exp < 1e-5;
+    if (!math_pass) errors++;
+    std::cout << "BS_MATH (in use)      : all within 1e-5 | Status=" << (math_pass ? "PASS" : "FAIL") << "\n";
+    std::cout << "Float kernel          : max abs " << float_abs << "  max rel " << float_rel << "\n";
+    std::cout << "Fixed kernel          : max abs " << fixed_abs << "  max rel " << fixed_rel
+              << " | Status=" << (fixed_pass ? "PASS" : "FAIL") << "\n";
+    std::cout << "  (BS_FX_FRAC=" << BS_FX_FRAC << " BS_PROB_FRAC=" << BS_PROB_FRAC
+              << " BS_PRICE_FRAC=" << BS_PRICE_FRAC << " BS_LOG_BITS=" << BS_LOG_BITS
+              << " BS_CDF_BITS=" << BS_CDF_BITS << ")\n";
+    std::cout << std::fixed;
+
+    // Implied volatility: quotes priced by the reference at known vols, solved
+    // in one batch. Where vega is small the vol is ill-determined, so the
+    // solved vol must reprice the quote instead.
+    const int   IV_K = 5, IV_V = 4, IV_T = 3;
+    const int   IV_N = IV_K * IV_V * IV_T * 2;
+    const float iv_K[IV_K] = { 160.0f, 180.0f, 200.0f, 220.0f, 240.0f };
+    const float iv_V[IV_V] = { 0.05f, 0.2f, 0.6f, 1.5f };
+    const float iv_T[IV_T] = { 0.1f, 1.0f, 3.0f };
+    static IVQuote    iv_quotes[IV_N];
+    static theta_type iv_vols[IV_N];
+    static float      iv_true[IV_N];
+    static double     iv_vega[IV_N];
+    BS_TEST_IV_QUOTES: for (int i = 0; i < IV_N; i++) {
+        IVQuote& q = iv_quotes[i];
+        q.S    = 200.0f;
+        q.K    = iv_K[i % IV_K];
+        q.T    = iv_T[(i / IV_K) % IV_T];
+        q.type = (i / (IV_K * IV_T)) % 2 ? OPTION_PUT : OPTION_CALL;
+        iv_true[i] = iv_V[i / (IV_K * IV_T * 2)];
+        double ref[CHAIN_GREEK_WORDS];
+        bs_reference(q.S, q.K, q.T, q.type, ref, iv_true[i]);
+        q.price    = ref[0];
+        iv_vega[i] = ref[3];
+    }
+    implied_vol_batch(iv_quotes, iv_vols, IV_N);
+
+    int    iv_errors  = 0;
+    double iv_max_err = 0;
+    BS_TEST_IV: for (int i = 0; i < IV_N; i++) {
+        double ref[CHAIN_GREEK_WORDS];
+        bs_reference(iv_quotes[i].S, iv_quotes[i].K, iv_quotes[i].T, iv_quotes[i].type, ref, iv_vols[i]);
+        double vol_err   = std::fabs(iv_vols[i] - iv_true[i]);
+        double price_err = std::fabs(ref[0] - iv_quotes[i].price);
+        bool pass = (iv_vega[i] > 1.0) ? vol_err < 1e-3 : price_err < 0.005;
+        if (iv_vega[i] > 1.0) iv_max_err = std::max(iv_max_err, vol_err);
+        if (!pass) {
+            iv_errors++;
+            std::cout << "IV FAIL: K=" << iv_quotes[i].K << " T=" << iv_quotes[i].T
+                      << (iv_quotes[i].type == OPTION_PUT ? " Put" : " Call")
+                      << " vol=" << iv_true[i] << " got " << iv_vols[i] << "\n";
+        }
+    }
+    errors += iv_errors;
+    std::cout << "\n-- Implied volatility (" << IV_N << " quotes, " << IV_ITERATIONS << " iterations) --\n";
+    std::cout << std::scientific << std::setprecision(3)
+              << "Max vol error (vega > 1) : " << iv_max_err
+              << " | Failed: " << iv_errors << "\n" << std::fixed;
+
+    // Price cache: a call and a put with Greeks (one full line), the spot
+    // walking around the mid. Every lookup must match chain_price, and a tick
+    // seen before hits unless another mapped to its line since (2000064 and
+    // 2000000 share line 0).
+    const int      CACHE_N = 10;
+    const uint32_t cache_ticks[CACHE_N] = { 2000000, 2000100, 2000000, 1999900, 2000100,
+                                            2000064, 2000000, 2000000, 2000100, 2000100 };
+    const int      CACHE_HITS = 5;
+    hls::stream<bit32_t> cache_chain;
+    BS_TEST_CACHE_CHAIN: for (int c = 0; c < 2; c++) {
+        cache_chain.write(float_to_bits(200.0f));
+        cache_chain.write(float_to_bits(1.0f));
+        cache_chain.write(c ? OPTION_PUT : OPTION_CALL);
+    }
+    chain_load(cache_chain, 2, true);
+
+    int cache_errors = 0;
+    BS_TEST_CACHE: for (int i = 0; i < CACHE_N; i++) {
+        cache_errors += cache_mismatches(cache_ticks[i]);
+    }
+    int hits, misses;
+    price_cache_stats(hits, misses);
+    bool cache_pass = hits == CACHE_HITS && misses == CACHE_N - CACHE_HITS;
+
+    // A parameter change drops every line: the last spot misses and reprices
+    bs_set_params(K, r, 0.3f, T);
+    cache_errors += cache_mismatches(cache_ticks[CACHE_N - 1]);
+    price_cache_stats(hits, misses);
+    cache_pass = cache_pass && hits == 0 && misses == 1 && cache_errors == 0;
+    if (!cache_pass) errors++;
+    std::cout << "\n-- Price cache (" << CACHE_N << " lookups, " << CACHE_HITS << " hits expected) --\n"
+              << "Mismatched words: " << cache_errors
+              << " | Status=" << (cache_pass ? "PASS" : "FAIL") << "\n";
+
+    // Feed clock: an expiry 30 days after a 09:30 timestamp, and a call
+    // loaded at 09:30 with half a year left. Between refreshes T holds; at
+    // each one T and the contract's maturity drop by the feed time since.
+    const uint64_t NS_PER_SEC = 1000000000ULL;
+    const uint64_t clock_t0   = 34200 * NS_PER_SEC;
+    const int      CLOCK_N    = 6;
+    const uint64_t clock_dt[CLOCK_N]      = { 0, NS_PER_SEC / 2, NS_PER_SEC, 3 * NS_PER_SEC / 2,
+                                              3600 * NS_PER_SEC, 86400 * NS_PER_SEC };
+    const uint64_t clock_refresh[CLOCK_N] = { 0, 0, NS_PER_SEC, NS_PER_SEC,
+                                              3600 * NS_PER_SEC, 86400 * NS_PER_SEC };
+    bs_set_params(200.0f, 0.05f, 0.2f, 1.0f);
+    bs_clock(clock_t0);
+    hls::stream<bit32_t> clock_chain;
+    clock_chain.write(float_to_bits(200.0f));
+    clock_chain.write(float_to_bits(0.5f));
+    clock_chain.write(OPTION_CALL);
+    chain_load(clock_chain, 1, false);
+    bs_set_expiry(clock_t0 + 30 * 86400 * NS_PER_SEC);
+
+    std::cout << "\n-- Feed clock (expiry 30 days out) --\n";
+    BS_TEST_CLOCK: for (int i = 0; i < CLOCK_N; i++) {
+        bs_clock(clock_t0 + clock_dt[i]);
+        double elapsed = clock_refresh[i] / BS_NS_PER_YEAR;
+        double T_exp   = 30.0 / 365.0 - elapsed;
+
+        result_type res;
+        black_scholes_price(200.0f, res);
+        chain_price(200.0f, out_stream);
+        float chain_hw = bits_to_float(out_stream.read());
+
+        double call_exp[CHAIN_GREEK_WORDS], chain_exp[CHAIN_GREEK_WORDS];
+        bs_reference(200.0, 200.0, T_exp, OPTION_CALL, call_exp);
+        bs_reference(200.0, 200.0, 0.5 - elapsed, OPTION_CALL, chain_exp);
+        bool pass = std::fabs(T - T_exp) < 1e-6 &&
+                    std::fabs(res.call - call_exp[0]) < 0.01 &&
+                    std::fabs(chain_hw - chain_exp[0]) < 0.01;
+        if (!pass) errors++;
+        std::cout << "t+" << std::left << std::setw(10) << clock_dt[i] / 1e9 << "s"
+                  << " | T=" << std::setprecision(8) << std::setw(11) << T << " Exp=" << std::setw(11) << T_exp
+                  << std::setprecision(3)
+                  << " | Call_HW=" << std::setw(7) << res.call << " Exp=" << std::setw(7) << call_exp[0]
+                  << " | Chain_HW=" << std::setw(7) << chain_hw << " Exp=" << std::setw(7) << chain_exp[0]
+                  << " | Status=" << (pass ? "PASS" : "FAIL") << "\n";
+    }
+    bs_set_expiry(0);
+    if (T != 1.0f) errors++;
+
+    // Realized volatility: a tick-rounded random walk with 30% volatility,
+    // a spot every 10 ms for 10 minutes, pushed into v once a second. v must
+    // hold until the returns cover a half-life, then track the walk.
+    const double   RV_SIGMA   = 0.3;
+    const uint64_t RV_STEP_NS = 10000000ULL;
+    const int      RV_N       = 60000;
+    std::mt19937                     rv_gen(12345);
+    std::normal_distribution<double> rv_normal(0.0, RV_SIGMA * std::sqrt(RV_STEP_NS / BS_NS_PER_YEAR));
+    bs_set_params(200.0f, 0.05f, 0.2f, 1.0f);
+    bs_set_vol_push(NS_PER_SEC);
+    double rv_S       = 200.0;
+    float  rv_v_early = 0;
+    BS_TEST_RV: for (int i = 0; i < RV_N; i++) {
+        uint64_t now = clock_t0 + i * RV_STEP_NS;
+        rv_S *= std::exp(rv_normal(rv_gen));
+        bs_observe((uint32_t)std::lround(rv_S * 10000.0), now);
+        if (now - clock_t0 == 20 * NS_PER_SEC) rv_v_early = v;
+    }
+    double rv_est = bs_realized_vol();
+    bool   rv_pass = rv_v_early == 0.2f &&
+                     std::fabs(rv_est - RV_SIGMA) < 0.05 * RV_SIGMA &&
+                     std::fabs(v - RV_SIGMA) < 0.05 * RV_SIGMA;
+    if (!rv_pass) errors++;
+    bs_set_vol_push(0);
+    std::cout << "\n-- Realized volatility (" << RV_N << " spots, sigma=" << RV_SIGMA << ") --\n"
+              << "v at 20s=" << rv_v_early << " | Estimate=" << rv_est << " | v=" << v
+              << " | Status=" << (rv_pass ? "PASS" : "FAIL") << "\n";
+
+    // American (CRR): the float tree against the same tree in double. With
+    // no dividends the American call is the European one, to within the
+    // tree's discretization error; the put is worth at least the European.
+    const int   CRR_N = 5;
+    const float crr_S[CRR_N] = { 160.0f, 180.0f, 200.0f, 220.0f, 240.0f };
+    bs_set_params(200.0f, 0.05f, 0.2f, 1.0f);
+    std::cout << "\n-- American (CRR, " << CRR_STEPS << " steps) --\n";
+    BS_TEST_CRR: for (int i = 0; i < CRR_N; i++) {
+        result_type res;
+        crr_american_price(crr_S[i], res);
+        double call_exp, put_exp, euro_call[CHAIN_GREEK_WORDS], euro_put[CHAIN_GREEK_WORDS];
+        crr_reference(crr_S[i], K, T, CRR_STEPS, call_exp, put_exp);
+        bs_reference(crr_S[i], K, T, OPTION_CALL, euro_call);
+        bs_reference(crr_S[i], K, T, OPTION_PUT,  euro_put);
+        bool pass = std::fabs(res.call - call_exp) < 1e-3 &&
+                    std::fabs(res.put  - put_exp)  < 1e-3 &&
+                    std::fabs(res.call - euro_call[0]) < 0.05 &&
+                    res.put > euro_put[0];
+        if (!pass) errors++;
+        std::cout << "S=" << std::left << std::setw(6) << crr_S[i]
+                  << " | Call_HW=" << std::setw(7) << res.call << " Exp=" << std::setw(7) << call_exp
+                  << " Euro=" << std::setw(7) << euro_call[0]
+                  << " | Put_HW="  << std::setw(7) << res.put  << " Exp=" << std::setw(7) << put_exp
+                  << " Euro=" << std::setw(7) << euro_put[0]
+                  << " | Status=" << (pass ? "PASS" : "FAIL") << "\n";
+    }
+
+    // Portfolio risk: long calls and short puts across a 4-contract chain,
+    // one update for a contract past the chain (dropped) and one that
+    // overwrites an earlier quantity. Updates that all miss the chain
+    // leave the risk words off. The sums must match the reference per
+    // contract, and the cached output (risk words included) chain_price.
+    const int   RISK_N = 3;
+    const float risk_S[RISK_N] = { 185.0f, 200.0f, 230.0f };
+    const int   risk_qty[4]    = { 10, -5, 3, -20 };
+    const int   risk_held      = 38;   // contracts held, long and short
+    hls::stream<bit32_t> risk_chain, risk_positions;
+    BS_TEST_RISK_CHAIN: for (int c = 0; c < 4; c++) {
+        risk_chain.write(float_to_bits(chain_K[c]));
+        risk_chain.write(float_to_bits(chain_T[c % 3]));
+        risk_chain.write((c & 1) ? OPTION_PUT : OPTION_CALL);
+    }
+    chain_load(risk_chain, 4, false);
+    position_set(4, 100);
+    position_set(-1, 100);
+    risk_positions.write(9);
+    risk_positions.write(100);
+    position_load(risk_positions, 1);
+    bool risk_off = (risk_words() == 0);
+    const int risk_updates[6][2] = { { 0, 7 }, { 1, -5 }, { 2, 3 }, { 3, -20 }, { 4, 100 }, { 0, 10 } };
+    BS_TEST_RISK_LOAD: for (int u = 0; u < 6; u++) {
+        risk_positions.write(risk_updates[u][0]);
+        risk_positions.write((uint32_t)risk_updates[u][1]);
+    }
+    position_load(risk_positions, 6);
+
+    std::cout << "\n-- Portfolio risk (" << chain_size() << " contracts, " << risk_words() << " words) --\n";
+    int risk_errors = (risk_off && risk_words() == RISK_WORDS) ? 0 : 1;
+    BS_TEST_RISK: for (int i = 0; i < RISK_N; i++) {
+        double exp[RISK_WORDS] = { 0, 0, 0 };
+        for (int c = 0; c < 4; c++) {
+            double ref[CHAIN_GREEK_WORDS];
+            bs_reference(risk_S[i], chain_K[c], chain_T[c % 3], (c & 1) ? OPTION_PUT : OPTION_CALL, ref);
+            for (int w = 0; w < RISK_WORDS; w++) exp[w] += risk_qty[c] * ref[w];
+        }
+        chain_price(risk_S[i], out_stream);
+        for (int c = 0; c < 4; c++) out_stream.read();
+        float hw[RISK_WORDS];
+        for (int w = 0; w < RISK_WORDS; w++) hw[w] = bits_to_float(out_stream.read());
+        // Price bound as above per unit held, relative for the Greeks
+        bool pass = std::fabs(hw[0] - exp[0]) < 0.01 * risk_held &&
+                    std::fabs(hw[1] - exp[1]) < 1e-3 * std::fabs(exp[1]) + 1e-4 &&
+                    std::fabs(hw[2] - exp[2]) < 1e-3 * std::fabs(exp[2]) + 1e-5 &&
+                    cache_mismatches((uint32_t)(risk_S[i] * 10000)) == 0;
+        if (!pass) risk_errors++;
+        std::cout << std::setprecision(2) << "S=" << std::left << std::setw(6) << risk_S[i] << std::setprecision(4)
+                  << " | Value=" << std::setw(9) << hw[0] << " Exp=" << std::setw(9) << exp[0]
+                  << " | Delta=" << std::setw(9) << hw[1] << " Exp=" << std::setw(9) << exp[1]
+                  << " | Gamma=" << std::setw(9) << hw[2] << " Exp=" << std::setw(9) << exp[2]
+                  << std::setprecision(2) << " | Status=" << (pass ? "PASS" : "FAIL") << "\n";
+    }
+    errors += risk_errors;
+
     // Summary
     std::cout << "\n";
     std::cout << "============================================\n";
     std::cout << " Black–Scholes FPGA Testbench Summary\n";
     std::cout << "============================================\n";
     std::cout << "Input file            : " << INPUT_ITCH_FILE << "\n";
-    std::cout << "Total test instances  : " << N << "\n\n";
+    std::cout << "Total test instances  : " << N << " + " << 2 * 3 * CHAIN_N << " chain + "
+              << PARAM_N << " runtime parameters + 2 accuracy + "
+              << IV_N << " implied vol + 1 cache + "
+              << CLOCK_N + 1 << " clock + 1 realized vol + "
+              << CRR_N << " American + " << RISK_N << " risk\n\n";
 
     std::cout << "Error rate            : " << std::setprecision(4)
-              << (100.0 * errors / N) << "%\n";
+              << (100.0 * errors / (N + 2 * 3 * CHAIN_N + PARAM_N + 2 + IV_N + 1 + CLOCK_N + 1 + 1 + CRR_N + RISK_N)) << "%\n";
     std::cout << "============================================\n";
 
     return 0;
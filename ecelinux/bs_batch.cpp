@@ -0,0 +1,376 @@
+#include "bs_batch.hpp"
+#include "blackscholes.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+// ---------------------------------------------------------------------
+// Vector types
+// ---------------------------------------------------------------------
+// Each vector unit gets a vfloat of WIDTH lanes with the arithmetic and
+// compares as operators (compares give a mask), converting from a float by
+// broadcast, an unaligned VF::load of WIDTH floats, and the same handful of
+// helpers:
+//   vstore           unaligned store of WIDTH floats
+//   vselect(m, a, b) a where m is set, else b
+//   vsqrt, vfloor, vabs, vmin, vmax
+//   vpow2i(n)        2^n, n integral in [-126, 127]
+//   vfrexp(x, e)     m with x = m 2^e, m in [0.5, 1), for normal x > 0
+// The kernels below are written once against these.
+
+#if defined(__AVX512F__)
+namespace avx512 {
+
+struct vfloat {
+  typedef __mmask16 mask;
+  static const int WIDTH = 16;
+  __m512 v;
+  vfloat() {}
+  vfloat(__m512 x) : v(x) {}
+  vfloat(float x) : v(_mm512_set1_ps(x)) {}
+  static vfloat load(const float *p) { return _mm512_loadu_ps(p); }
+};
+
+inline void      vstore(float *p, vfloat a)     { _mm512_storeu_ps(p, a.v); }
+inline vfloat    operator+(vfloat a, vfloat b)  { return _mm512_add_ps(a.v, b.v); }
+inline vfloat    operator-(vfloat a, vfloat b)  { return _mm512_sub_ps(a.v, b.v); }
+inline vfloat    operator*(vfloat a, vfloat b)  { return _mm512_mul_ps(a.v, b.v); }
+inline vfloat    operator/(vfloat a, vfloat b)  { return _mm512_div_ps(a.v, b.v); }
+inline __mmask16 operator<(vfloat a, vfloat b)  { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ); }
+inline __mmask16 operator>(vfloat a, vfloat b)  { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ); }
+inline __mmask16 operator>=(vfloat a, vfloat b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ); }
+inline vfloat vselect(__mmask16 m, vfloat a, vfloat b) { return _mm512_mask_blend_ps(m, b.v, a.v); }
+inline vfloat vsqrt(vfloat a)             { return _mm512_sqrt_ps(a.v); }
+inline vfloat vfloor(vfloat a)            { return _mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+inline vfloat vmin(vfloat a, vfloat b)    { return _mm512_min_ps(a.v, b.v); }
+inline vfloat vmax(vfloat a, vfloat b)    { return _mm512_max_ps(a.v, b.v); }
+
+inline vfloat vabs(vfloat a) {
+  return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a.v), _mm512_set1_epi32(0x7FFFFFFF)));
+}
+
+inline vfloat vpow2i(vfloat n) {
+  __m512i e = _mm512_add_epi32(_mm512_cvtps_epi32(n.v), _mm512_set1_epi32(127));
+  return _mm512_castsi512_ps(_mm512_slli_epi32(e, 23));
+}
+
+inline vfloat vfrexp(vfloat x, vfloat &e) {
+  __m512i bits = _mm512_castps_si512(x.v);
+  __m512i exp  = _mm512_and_si512(_mm512_srli_epi32(bits, 23), _mm512_set1_epi32(0xFF));
+  e = _mm512_cvtepi32_ps(_mm512_sub_epi32(exp, _mm512_set1_epi32(126)));
+  bits = _mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi32(0x807FFFFF)), _mm512_set1_epi32(0x3F000000));
+  return _mm512_castsi512_ps(bits);
+}
+
+} // namespace avx512
+typedef avx512::vfloat bs_vec_t;
+#define BS_BATCH_ISA "avx512"
+#define BS_BATCH_VEC
+
+#elif defined(__AVX2__)
+namespace avx2 {
+
+struct vmask {
+  __m256 m;
+  vmask(__m256 x) : m(x) {}
+};
+inline vmask operator&(vmask a, vmask b) { return _mm256_and_ps(a.m, b.m); }
+
+struct vfloat {
+  typedef vmask mask;
+  static const int WIDTH = 8;
+  __m256 v;
+  vfloat() {}
+  vfloat(__m256 x) : v(x) {}
+  vfloat(float x) : v(_mm256_set1_ps(x)) {}
+  static vfloat load(const float *p) { return _mm256_loadu_ps(p); }
+};
+
+inline void   vstore(float *p, vfloat a)     { _mm256_storeu_ps(p, a.v); }
+inline vfloat operator+(vfloat a, vfloat b)  { return _mm256_add_ps(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b)  { return _mm256_sub_ps(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b)  { return _mm256_mul_ps(a.v, b.v); }
+inline vfloat operator/(vfloat a, vfloat b)  { return _mm256_div_ps(a.v, b.v); }
+inline vmask  operator<(vfloat a, vfloat b)  { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline vmask  operator>(vfloat a, vfloat b)  { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline vmask  operator>=(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline vfloat vselect(vmask m, vfloat a, vfloat b) { return _mm256_blendv_ps(b.v, a.v, m.m); }
+inline vfloat vsqrt(vfloat a)                { return _mm256_sqrt_ps(a.v); }
+inline vfloat vfloor(vfloat a)               { return _mm256_floor_ps(a.v); }
+inline vfloat vmin(vfloat a, vfloat b)       { return _mm256_min_ps(a.v, b.v); }
+inline vfloat vmax(vfloat a, vfloat b)       { return _mm256_max_ps(a.v, b.v); }
+
+inline vfloat vabs(vfloat a) {
+  return _mm256_and_ps(a.v, _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF)));
+}
+
+inline vfloat vpow2i(vfloat n) {
+  __m256i e = _mm256_add_epi32(_mm256_cvtps_epi32(n.v), _mm256_set1_epi32(127));
+  return _mm256_castsi256_ps(_mm256_slli_epi32(e, 23));
+}
+
+inline vfloat vfrexp(vfloat x, vfloat &e) {
+  __m256i bits = _mm256_castps_si256(x.v);
+  __m256i exp  = _mm256_and_si256(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(0xFF));
+  e = _mm256_cvtepi32_ps(_mm256_sub_epi32(exp, _mm256_set1_epi32(126)));
+  bits = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x807FFFFF)), _mm256_set1_epi32(0x3F000000));
+  return _mm256_castsi256_ps(bits);
+}
+
+} // namespace avx2
+typedef avx2::vfloat bs_vec_t;
+#define BS_BATCH_ISA "avx2"
+#define BS_BATCH_VEC
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+namespace neon {
+
+struct vmask {
+  uint32x4_t m;
+  vmask(uint32x4_t x) : m(x) {}
+};
+inline vmask operator&(vmask a, vmask b) { return vandq_u32(a.m, b.m); }
+
+struct vfloat {
+  typedef vmask mask;
+  static const int WIDTH = 4;
+  float32x4_t v;
+  vfloat() {}
+  vfloat(float32x4_t x) : v(x) {}
+  vfloat(float x) : v(vdupq_n_f32(x)) {}
+  static vfloat load(const float *p) { return vld1q_f32(p); }
+};
+
+inline void   vstore(float *p, vfloat a)     { vst1q_f32(p, a.v); }
+inline vfloat operator+(vfloat a, vfloat b)  { return vaddq_f32(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b)  { return vsubq_f32(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b)  { return vmulq_f32(a.v, b.v); }
+inline vmask  operator<(vfloat a, vfloat b)  { return vcltq_f32(a.v, b.v); }
+inline vmask  operator>(vfloat a, vfloat b)  { return vcgtq_f32(a.v, b.v); }
+inline vmask  operator>=(vfloat a, vfloat b) { return vcgeq_f32(a.v, b.v); }
+inline vfloat vselect(vmask m, vfloat a, vfloat b) { return vbslq_f32(m.m, a.v, b.v); }
+inline vfloat vabs(vfloat a)                 { return vabsq_f32(a.v); }
+inline vfloat vmin(vfloat a, vfloat b)       { return vminq_f32(a.v, b.v); }
+inline vfloat vmax(vfloat a, vfloat b)       { return vmaxq_f32(a.v, b.v); }
+
+// 32-bit ARM has no vector divide, square root or floor: reciprocal and
+// reciprocal square root estimates with two Newton steps each (float
+// accuracy), and floor from truncation (|a| < 2^31)
+#if defined(__aarch64__)
+inline vfloat operator/(vfloat a, vfloat b)  { return vdivq_f32(a.v, b.v); }
+inline vfloat vsqrt(vfloat a)                { return vsqrtq_f32(a.v); }
+inline vfloat vfloor(vfloat a)               { return vrndmq_f32(a.v); }
+#else
+inline vfloat operator/(vfloat a, vfloat b) {
+  float32x4_t inv = vrecpeq_f32(b.v);
+  inv = vmulq_f32(vrecpsq_f32(b.v, inv), inv);
+  inv = vmulq_f32(vrecpsq_f32(b.v, inv), inv);
+  return vmulq_f32(a.v, inv);
+}
+
+inline vfloat vsqrt(vfloat a) {
+  float32x4_t rs = vrsqrteq_f32(a.v);
+  rs = vmulq_f32(vrsqrtsq_f32(vmulq_f32(a.v, rs), rs), rs);
+  rs = vmulq_f32(vrsqrtsq_f32(vmulq_f32(a.v, rs), rs), rs);
+  return vselect(a > vfloat(0.0f), vmulq_f32(a.v, rs), vfloat(0.0f));
+}
+
+inline vfloat vfloor(vfloat a) {
+  vfloat t = vcvtq_f32_s32(vcvtq_s32_f32(a.v));
+  return vselect(t > a, t - vfloat(1.0f), t);
+}
+#endif
+
+inline vfloat vpow2i(vfloat n) {
+  int32x4_t e = vaddq_s32(vcvtq_s32_f32(n.v), vdupq_n_s32(127));
+  return vreinterpretq_f32_s32(vshlq_n_s32(e, 23));
+}
+
+inline vfloat vfrexp(vfloat x, vfloat &e) {
+  uint32x4_t bits = vreinterpretq_u32_f32(x.v);
+  int32x4_t  exp  = vreinterpretq_s32_u32(vandq_u32(vshrq_n_u32(bits, 23), vdupq_n_u32(0xFF)));
+  e = vcvtq_f32_s32(vsubq_s32(exp, vdupq_n_s32(126)));
+  bits = vorrq_u32(vandq_u32(bits, vdupq_n_u32(0x807FFFFF)), vdupq_n_u32(0x3F000000));
+  return vreinterpretq_f32_u32(bits);
+}
+
+} // namespace neon
+typedef neon::vfloat bs_vec_t;
+#define BS_BATCH_ISA "neon"
+#define BS_BATCH_VEC
+
+#else
+#define BS_BATCH_ISA "scalar"
+#endif
+
+// ---------------------------------------------------------------------
+// Kernels
+// ---------------------------------------------------------------------
+// Natural log, x > 0: log(x) = e log(2) + log(m), with m in [sqrt(1/2),
+// sqrt(2)) and log(1 + f) a degree-9 polynomial in f (Cephes logf)
+template<class VF>
+static inline VF vlog(VF x) {
+  VF e;
+  VF m = vfrexp(x, e);
+  typename VF::mask small = m < VF(0.70710678f);
+  e = vselect(small, e - VF(1.0f), e);
+  m = vselect(small, m + m - VF(1.0f), m - VF(1.0f));
+
+  VF z = m * m;
+  VF y = VF(7.0376836292e-2f);
+  y = y * m - VF(1.1514610310e-1f);
+  y = y * m + VF(1.1676998740e-1f);
+  y = y * m - VF(1.2420140846e-1f);
+  y = y * m + VF(1.4249322787e-1f);
+  y = y * m - VF(1.6668057665e-1f);
+  y = y * m + VF(2.0000714765e-1f);
+  y = y * m - VF(2.4999993993e-1f);
+  y = y * m + VF(3.3333331174e-1f);
+  y = y * m * z;
+  y = y - e * VF(2.12194440e-4f) - z * VF(0.5f);
+  return m + y + e * VF(0.693359375f);
+}
+
+// e^x: 2^n e^g with n = round(x log2(e)), |g| <= log(2) / 2 and e^g a
+// degree-7 polynomial (Cephes expf). 0 / FLT_MAX range ends are clamped.
+template<class VF>
+static inline VF vexp(VF x) {
+  x = vmin(vmax(x, VF(-87.3f)), VF(88.3f));
+  VF n = vfloor(x * VF(1.44269504f) + VF(0.5f));
+  x = x - n * VF(0.693359375f) + n * VF(2.12194440e-4f);
+
+  VF z = x * x;
+  VF y = VF(1.9875691500e-4f);
+  y = y * x + VF(1.3981999507e-3f);
+  y = y * x + VF(8.3334519073e-3f);
+  y = y * x + VF(4.1665795894e-2f);
+  y = y * x + VF(1.6666665459e-1f);
+  y = y * x + VF(5.0000001201e-1f);
+  y = y * z + x + VF(1.0f);
+  return y * vpow2i(n);
+}
+
+// Standard normal CDF, Abramowitz-Stegun 26.2.17 (as MathLibm::cdf)
+template<class VF>
+static inline VF vcdf(VF x) {
+  VF k = VF(1.0f) / (vabs(x) * VF(0.2316419f) + VF(1.0f));
+  VF w = VF(1.330274429f);
+  w = w * k - VF(1.821255978f);
+  w = w * k + VF(1.781477937f);
+  w = w * k - VF(0.356563782f);
+  w = w * k + VF(0.31938153f);
+  w = w * k * vexp(x * x * VF(-0.5f)) * VF(0.3989422804f);
+  return vselect(x >= VF(0.0f), VF(1.0f) - w, w);
+}
+
+/**
+ * WIDTH options from S, K, T at offset 0: the formula of
+ * black_scholes_price, with the strike and maturity terms per option.
+ * Lanes with a non-positive input are computed anyway and zeroed at the
+ * end, so there is no branch.
+ */
+template<class VF>
+static inline void bs_step(const float *S, const float *K, const float *T, float *call, float *put) {
+  VF s = VF::load(S);
+  VF k = VF::load(K);
+  VF t = VF::load(T);
+  typename VF::mask ok = (s > VF(0.0f)) & (k > VF(0.0f)) & (t > VF(0.0f)) & (VF(v) > VF(0.0f));
+
+  VF vsqrtT = vsqrt(t) * VF(v);
+  VF d1     = (vlog(s / k) + t * VF(r + 0.5f * v * v)) / vsqrtT;
+  VF d2     = d1 - vsqrtT;
+  VF KD     = k * vexp(t * VF(-r));
+
+  VF Nd1 = vcdf(d1);
+  VF Nd2 = vcdf(d2);
+  VF c   = s * Nd1 - KD * Nd2;
+  VF p   = KD * (VF(1.0f) - Nd2) - s * (VF(1.0f) - Nd1);
+  vstore(call, vselect(ok, c, VF(0.0f)));
+  vstore(put,  vselect(ok, p, VF(0.0f)));
+}
+
+// Terms of one maturity, kept while consecutive options share it
+struct BsTime {
+  float T;
+  float vsqrtT;      // v sqrt(T)
+  float inv_denom;   // 1 / (v sqrt(T))
+  float drift;       // (r + v^2 / 2) T
+  float disc;        // e^{-rT}
+};
+
+static inline BsTime bs_time(float T_c) {
+  BsTime t;
+  t.T         = T_c;
+  t.vsqrtT    = v * std::sqrt(T_c);
+  t.inv_denom = 1.0f / t.vsqrtT;
+  t.drift     = (r + 0.5f * v * v) * T_c;
+  t.disc      = std::exp(-r * T_c);
+  return t;
+}
+
+/**
+ * One option by the formula of black_scholes_price, with its bs_math_t log
+ * and N(x) (libm with BS_MATH=MathLibm): the polynomials above only pay off
+ * when they fill a vector, one option at a time they are slower.
+ */
+static inline void bs_option(float S, float K_c, const BsTime &t, float &call, float &put) {
+  if (!(S > 0 && K_c > 0 && t.T > 0 && v > 0)) {
+    call = 0.0f;
+    put  = 0.0f;
+    return;
+  }
+  float d1 = (bs_math_t::log(S / K_c) + t.drift) * t.inv_denom;
+  float d2 = d1 - t.vsqrtT;
+  float KD = K_c * t.disc;
+
+  float Nd1 = bs_math_t::cdf(d1);
+  float Nd2 = bs_math_t::cdf(d2);
+  call = S * Nd1 - KD * Nd2;
+  put  = KD * (1.0f - Nd2) - S * (1.0f - Nd1);
+}
+
+void bs_batch_scalar(const float S[], const float K[], const float T[],
+                     float call[], float put[], int n) {
+  BsTime t = bs_time(0.0f);
+  BS_BATCH_ONE: for (int i = 0; i < n; i++) {
+    if (T[i] != t.T) t = bs_time(T[i]);
+    bs_option(S[i], K[i], t, call[i], put[i]);
+  }
+}
+
+#ifdef BS_BATCH_VEC
+// Whole vectors, then the remainder one option at a time
+void bs_batch(const float S[], const float K[], const float T[],
+              float call[], float put[], int n) {
+  const int W = bs_vec_t::WIDTH;
+  int i = 0;
+  BS_BATCH_STEP: for (; i + W <= n; i += W) {
+    bs_step<bs_vec_t>(S + i, K + i, T + i, call + i, put + i);
+  }
+  bs_batch_scalar(S + i, K + i, T + i, call + i, put + i, n - i);
+}
+
+int bs_batch_width() {
+  return bs_vec_t::WIDTH;
+}
+#else
+void bs_batch(const float S[], const float K[], const float T[],
+              float call[], float put[], int n) {
+  bs_batch_scalar(S, K, T, call, put, n);
+}
+
+int bs_batch_width() {
+  return 1;
+}
+#endif
+
+const char* bs_batch_isa() {
+  return BS_BATCH_ISA;
+}
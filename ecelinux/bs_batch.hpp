@@ -0,0 +1,38 @@
+//===========================================================================
+// bs_batch.hpp
+//===========================================================================
+// @brief: This header file defines the batched Black-Scholes pricer for the
+//         host (CPU) build.
+
+#ifndef BS_BATCH_HPP
+#define BS_BATCH_HPP
+
+// Prices n options, each with its own spot S[i], strike K[i] and maturity
+// T[i] (years), at the global rate and volatility (blackscholes.hpp). The
+// arrays are separate (structure of arrays), so a vector register holds the
+// same field of consecutive options; they need no particular alignment.
+// call[i] and put[i] are 0 where S, K, T or v is not positive.
+//
+// bs_batch uses the widest vector unit the file was compiled for:
+//   - AVX-512F:         16 options per step (-mavx512f)
+//   - AVX2:              8 options per step (-mavx2)
+//   - NEON:              4 options per step (-mfpu=neon on 32-bit ARM,
+//                        always on AArch64)
+//   - none:              bs_batch_scalar
+// Vector steps use the Cephes log and exp polynomials (about 1 ulp) and the
+// Abramowitz-Stegun N(x) (7.5e-8 absolute). bs_batch_scalar, which also
+// prices the options left over after the last whole vector, runs the
+// formula of black_scholes_price one option at a time with its bs_math_t
+// log and N(x), reusing the maturity terms while T repeats. Both are
+// within 1e-4 of double precision for S, K up to a few hundred.
+void bs_batch(const float S[], const float K[], const float T[],
+              float call[], float put[], int n);
+void bs_batch_scalar(const float S[], const float K[], const float T[],
+                     float call[], float put[], int n);
+
+// Vector unit bs_batch was built for ("avx512", "avx2", "neon" or "scalar"),
+// and the options it prices per step
+const char* bs_batch_isa();
+int bs_batch_width();
+
+#endif // BS_BATCH_HPP
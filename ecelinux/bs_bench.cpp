@@ -0,0 +1,117 @@
+//=========================================================================
+// bs_bench.cpp
+//=========================================================================
+// @brief: throughput of the host Black-Scholes pricers on an option chain
+//
+// @usage: ./bs_bench [updates]
+//         prices a CHAIN_MAX-contract chain once per spot update with
+//         black_scholes_price (one option per call, the scalar reference),
+//         bs_batch_scalar and bs_batch, then checks both batch pricers
+//         against double precision
+
+#include "blackscholes.hpp"
+#include "bs_batch.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+static const int    BENCH_CHAIN = CHAIN_MAX;
+static const double BENCH_TOL   = 2e-4;   // $, see bs_batch.hpp
+
+// Seconds taken by fn(spot) over all updates
+template<class F>
+static double time_updates(const std::vector<float>& spots, F fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (float S : spots) fn(S);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void reference(double S, double K_c, double T_c, double& call, double& put) {
+    double sqrtT = std::sqrt(T_c);
+    double d1 = (std::log(S / K_c) + (r + 0.5 * v * v) * T_c) / (v * sqrtT);
+    double d2 = d1 - v * sqrtT;
+    double KD = K_c * std::exp(-r * T_c);
+    call = S * 0.5 * std::erfc(-d1 / std::sqrt(2.0)) - KD * 0.5 * std::erfc(-d2 / std::sqrt(2.0));
+    put  = KD * 0.5 * std::erfc(d2 / std::sqrt(2.0)) - S * 0.5 * std::erfc(d1 / std::sqrt(2.0));
+}
+
+int main(int argc, char** argv) {
+    int updates = (argc > 1) ? std::atoi(argv[1]) : 20000;
+
+    // Chain: 32 strikes from 160 to 238 at 8 maturities from 1 week to 2 years
+    std::vector<float> S(BENCH_CHAIN), K(BENCH_CHAIN), T(BENCH_CHAIN);
+    std::vector<float> call(BENCH_CHAIN), put(BENCH_CHAIN);
+    const float maturities[8] = { 1.0f / 52, 1.0f / 12, 0.25f, 0.5f, 0.75f, 1.0f, 1.5f, 2.0f };
+    BENCH_CHAIN_INIT: for (int i = 0; i < BENCH_CHAIN; i++) {
+        K[i] = 160.0f + 2.5f * (i % 32);
+        T[i] = maturities[(i / 32) % 8];
+    }
+
+    // Spot walk around 200 in cent steps
+    std::vector<float> spots(updates);
+    float spot = 200.0f;
+    BENCH_SPOTS: for (int u = 0; u < updates; u++) {
+        spot += ((u * 7919) % 3 - 1) * 0.01f;
+        spots[u] = spot;
+    }
+
+    // Scalar reference: one black_scholes_price per contract. It prices at
+    // the global K and T, so it is given the same work, not the same chain.
+    volatile float sink = 0;
+    double t_ref = time_updates(spots, [&](float s) {
+        BENCH_REF: for (int i = 0; i < BENCH_CHAIN; i++) {
+            result_type res;
+            black_scholes_price(s, res);
+            sink = sink + res.call;
+        }
+    });
+    double t_scalar = time_updates(spots, [&](float s) {
+        std::fill(S.begin(), S.end(), s);
+        bs_batch_scalar(S.data(), K.data(), T.data(), call.data(), put.data(), BENCH_CHAIN);
+        sink = sink + call[0];
+    });
+    double t_batch = time_updates(spots, [&](float s) {
+        std::fill(S.begin(), S.end(), s);
+        bs_batch(S.data(), K.data(), T.data(), call.data(), put.data(), BENCH_CHAIN);
+        sink = sink + call[0];
+    });
+
+    // Accuracy over the chain at spots across the strikes
+    const float check_S[5] = { 150.0f, 180.0f, 200.0f, 220.0f, 250.0f };
+    double err_scalar = 0, err_batch = 0;
+    std::vector<float> call_s(BENCH_CHAIN), put_s(BENCH_CHAIN);
+    BENCH_CHECK: for (float s : check_S) {
+        std::fill(S.begin(), S.end(), s);
+        bs_batch_scalar(S.data(), K.data(), T.data(), call_s.data(), put_s.data(), BENCH_CHAIN);
+        bs_batch(S.data(), K.data(), T.data(), call.data(), put.data(), BENCH_CHAIN);
+        for (int i = 0; i < BENCH_CHAIN; i++) {
+            double c, p;
+            reference(s, K[i], T[i], c, p);
+            err_scalar = std::max(err_scalar, std::max(std::fabs(call_s[i] - c), std::fabs(put_s[i] - p)));
+            err_batch  = std::max(err_batch,  std::max(std::fabs(call[i] - c),   std::fabs(put[i] - p)));
+        }
+    }
+    bool pass = err_scalar < BENCH_TOL && err_batch < BENCH_TOL;
+
+    double options = (double)updates * BENCH_CHAIN;
+    std::cout << "\n";
+    std::cout << "============================================\n";
+    std::cout << " Black–Scholes Host Batch Benchmark\n";
+    std::cout << "============================================\n";
+    std::cout << "Chain x updates       : " << BENCH_CHAIN << " x " << updates << "\n";
+    std::cout << "Vector unit           : " << bs_batch_isa() << " (" << bs_batch_width() << " options per step)\n\n";
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "black_scholes_price   : " << std::setw(7) << 1e9 * t_ref    / options << " ns/option\n";
+    std::cout << "bs_batch_scalar       : " << std::setw(7) << 1e9 * t_scalar / options << " ns/option ("
+              << t_ref / t_scalar << "x)\n";
+    std::cout << "bs_batch              : " << std::setw(7) << 1e9 * t_batch  / options << " ns/option ("
+              << t_ref / t_batch << "x)\n\n";
+    std::cout << std::scientific << std::setprecision(3);
+    std::cout << "Max abs error scalar  : " << err_scalar << "\n";
+    std::cout << "Max abs error batch   : " << err_batch << "\n";
+    std::cout << "Status                : " << (pass ? "PASS" : "FAIL") << "\n";
+    std::cout << "============================================\n";
+
+    return pass ? 0 : 1;
+}
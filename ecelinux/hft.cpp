@@ -1,16 +1,100 @@
 #include "hft.hpp"
 
-void dut(hls::stream<bit32_t> &strm_in, hls::stream<bit32_t> &strm_out) {
-    // ------------------------------------------------------
-    // Input processing
-    // ------------------------------------------------------
-    bit32_t hdr    = strm_in.read();
+// ---------------------------------------------------------------------
+// Jobs
+// ---------------------------------------------------------------------
+// The book process hands the pricing process one job per dut call: a header
+// word, code in bits 31..24, then its words. Commands for the pricing state
+// are passed on as they came in, HDR_CMD_* header and payload; the rest use
+// codes above those.
+#define JOB_NONE     0x80   // nothing for the pricing side
+#define JOB_TICK     0x81   // feed time (hi, lo) of a message that left the spot
+#define JOB_PRICE    0x82   // feed time (hi, lo), tag, spot: price the chain
+#define JOB_FORWARD  0x83   // (bits 15..0) words follow, copied to strm_out
+#define JOB_SNAPSHOT 0x84   // a book snapshot follows, copied to strm_out
+
+#define JOB_DEPTH    32
+
+static bit32_t job_head(bit8_t code, bit16_t len) {
+#pragma HLS INLINE
+    bit32_t head = 0;
+    head(31, 24) = code;
+    head(15, 0)  = len;
+    return head;
+}
+
+// ---------------------------------------------------------------------
+// Book process
+// ---------------------------------------------------------------------
+/**
+ * Reads one command from strm_in and applies the book's part of it: parses
+ * an ITCH message into the book, writes the touch to strm_bbo, and leaves
+ * the job for the pricing process. Book outputs for strm_out go through
+ * the job stream, so strm_out keeps a single writer.
+ */
+static void hft_book(hls::stream<bit32_t> &strm_in, hls::stream<bit32_t> &strm_bbo,
+                     hls::stream<bit32_t> &job COLD_STORE_PORTS) {
+#if !COLD_STORE
+    // On-chip cold store
+    static ColdOrder      cold_orders[COLD_ORDERS];
+    static ColdIndexEntry cold_index[COLD_INDEX_ENTRIES];
+#endif
+
+    bit32_t hdr = strm_in.read();
+
+    if (hdr(31, 24) == HDR_CMD_RESET) {
+        ParsedMessage reset;
+        reset.type = MSG_RESET;
+        reset.stock_locate = hdr(15, 0);
+        orderbook(&reset, cold_orders, cold_index);
+        job.write(job_head(JOB_NONE, 0));
+        return;
+    }
+    if (hdr(31, 24) == HDR_CMD_DUMP) {
+        job.write(job_head(JOB_SNAPSHOT, 0));
+        orderbook_dump(job, cold_orders);
+        return;
+    }
+    if (hdr(31, 24) == HDR_CMD_LOAD) {
+        orderbook_load(strm_in, strm_in.read(), cold_orders, cold_index);
+        job.write(job_head(JOB_NONE, 0));
+        return;
+    }
+    if (hdr(31, 24) == HDR_CMD_STATS) {
+        job.write(job_head(JOB_FORWARD, STATS_WORDS));
+        orderbook_stats(job);
+        return;
+    }
+    if (hdr(31, 24) == HDR_CMD_SYNC) {
+        strm_bbo.write(OUT_TAG_SYNC | hdr(15, 0));
+        job.write(job_head(JOB_FORWARD, 1));
+        job.write(OUT_TAG_SYNC | hdr(15, 0));
+        return;
+    }
+
+    // Pricing commands: the header and its payload, word for word
+    int payload = -1;
+    if (hdr(31, 24) == HDR_CMD_CHAIN)    payload = hdr(15, 0) * CONTRACT_WORDS;
+    if (hdr(31, 24) == HDR_CMD_PARAMS)   payload = PARAM_WORDS;
+    if (hdr(31, 24) == HDR_CMD_EXPIRY)   payload = EXPIRY_WORDS;
+    if (hdr(31, 24) == HDR_CMD_POSITION) payload = hdr(15, 0) * POSITION_WORDS;
+    if (hdr(31, 24) == HDR_CMD_VOL)      payload = 0;
+    if (payload >= 0) {
+        job.write(hdr);
+        HFT_PASS: for (int w = 0; w < payload; w++) {
+        #pragma HLS PIPELINE II=1
+        #pragma HLS LOOP_TRIPCOUNT max=CHAIN_MAX*CONTRACT_WORDS
+            job.write(strm_in.read());
+        }
+        return;
+    }
+
     uint16_t msg_len = (uint16_t)hdr(15, 0);
     assert(msg_len == (uint16_t)hdr(15, 0));
 
-    char in_buffer[36];   // 36 bytes is enough for our ITCH msgs
+    char in_buffer[ITCH_BUFFER_BYTES];
     int  idx   = 0;
-    
+
     // Handle variable msg length
     bit4_t words = (msg_len + 3) >> 2;    // # of 32-bit words = ceil(msg_len/4)
     assert((msg_len + 3) >> 2 == (bit16_t)words);
@@ -18,42 +102,142 @@ void dut(hls::stream<bit32_t> &strm_in, hls::stream<bit32_t> &strm_out) {
     #pragma HLS PIPELINE II=1
         bit32_t word = strm_in.read();
 
-        if (idx < msg_len){
+        if (idx < msg_len && idx + 4 <= ITCH_BUFFER_BYTES){
             in_buffer[idx++] = (char)word(31,24);
             in_buffer[idx++] = (char)word(23,16);
             in_buffer[idx++] = (char)word(15, 8);
             in_buffer[idx++] = (char)word( 7, 0);
-        } 
+        }
     }
 
-    // ------------------------------------------------------
-    // Call functions
-    // ------------------------------------------------------
     ParsedMessage parsed = parser(in_buffer);
+    SpotUpdate    update = orderbook(&parsed, cold_orders, cold_index);
+
+    // The touch goes out as soon as the book has it, ahead of any pricing
+    if (update.bboChanged) {
+        strm_bbo.write(update.seq);
+        strm_bbo.write(update.bid);
+        strm_bbo.write(update.bidShares);
+        strm_bbo.write(update.ask);
+        strm_bbo.write(update.askShares);
+    }
+
+    // Every message advances the pricing clock; the chain is priced only
+    // when the spot moved
+    bit64_t now_ns = parsed.timestamp;
+    job.write(job_head(update.changed ? JOB_PRICE : JOB_TICK, 0));
+    job.write(now_ns(63, 32));
+    job.write(now_ns(31, 0));
+    if (!update.changed) return;
+    job.write(update.valid ? update.seq : (bit32_t)(update.seq | TAG_SPOT_INVALID));
+    job.write(update.spot);
+}
 
-    bit32_t spot_price_ticks = orderbook(&parsed);
+// ---------------------------------------------------------------------
+// Pricing process
+// ---------------------------------------------------------------------
+/**
+ * Copies a book snapshot from the job stream to strm_out. Its length is
+ * read from its own header (see orderbook.hpp).
+ */
+static void pass_snapshot(hls::stream<bit32_t> &job, hls::stream<bit32_t> &strm_out) {
+    bit32_t levels = 0;
+    bit32_t orders = 0;
+    HFT_SNAPSHOT_HEADER: for (int w = 0; w < SNAPSHOT_HEADER_WORDS; w++) {
+    #pragma HLS PIPELINE II=1
+        bit32_t word = job.read();
+        if (w == 7) levels = word;   // L
+        if (w == 8) orders = word;   // N
+        strm_out.write(word);
+    }
+    int words = levels * SNAPSHOT_LEVEL_WORDS + orders * SNAPSHOT_ORDER_WORDS;
+    HFT_SNAPSHOT_BODY: for (int w = 0; w < words; w++) {
+    #pragma HLS PIPELINE II=1
+    #pragma HLS LOOP_TRIPCOUNT max=1024
+        strm_out.write(job.read());
+    }
+}
+
+/**
+ * Takes one job from the book process: applies a pricing command, copies a
+ * book output to strm_out, or advances the clock and prices the chain.
+ */
+static void hft_price(hls::stream<bit32_t> &job, hls::stream<bit32_t> &strm_out) {
+    bit32_t head = job.read();
+
+    if (head(31, 24) == JOB_NONE) return;
+    if (head(31, 24) == JOB_SNAPSHOT) {
+        pass_snapshot(job, strm_out);
+        return;
+    }
+    if (head(31, 24) == JOB_FORWARD) {
+        HFT_FORWARD: for (int w = 0; w < head(15, 0); w++) {
+        #pragma HLS PIPELINE II=1
+        #pragma HLS LOOP_TRIPCOUNT max=STATS_WORDS
+            strm_out.write(job.read());
+        }
+        return;
+    }
+    if (head(31, 24) == HDR_CMD_CHAIN) {
+        chain_load(job, head(15, 0), (head & HDR_CHAIN_GREEKS) != 0);
+        return;
+    }
+    if (head(31, 24) == HDR_CMD_PARAMS) {
+        bs_load_params(job);
+        return;
+    }
+    if (head(31, 24) == HDR_CMD_EXPIRY) {
+        bs_load_expiry(job);
+        return;
+    }
+    if (head(31, 24) == HDR_CMD_POSITION) {
+        position_load(job, head(15, 0));
+        return;
+    }
+    if (head(31, 24) == HDR_CMD_VOL) {
+        bs_set_vol_push((bit64_t)head(15, 0) * 1000000);
+        return;
+    }
+
+    // Advance the pricing clock to the message's timestamp
+    bit64_t now_ns = 0;
+    now_ns(63, 32) = job.read();
+    now_ns(31, 0)  = job.read();
+    bs_clock(now_ns);
+    if (head(31, 24) == JOB_TICK) return;
+
+    bit32_t tag  = job.read();
+    bit32_t spot = job.read();
+
+    // Only price off a valid spot
+    if (tag & TAG_SPOT_INVALID) {
+        strm_out.write(tag);
+        chain_price_cached(0, strm_out);
+        return;
+    }
 
-    float S_f = (float)spot_price_ticks / 10000.0f;
-    union { float f; int i; } u_in;
-    u_in.f = S_f;
-    bit32_t spot_price_bits = (bit32_t)u_in.i;
-    
-    result_type result = bs(spot_price_bits);
+    // Feed the new spot to the volatility estimate, which may push it into v
+    bs_observe(spot, now_ns);
 
-    // ------------------------------------------------------
-    // Output processing
-    // ------------------------------------------------------
-    // Convert results back to 32-bit words
-    union { float fval; int ival; } ucall;
-    union { float fval; int ival; } uput;
+    // Write output to stream (tag, then the price and any Greeks per contract)
+    strm_out.write(tag);
+    chain_price_cached(spot, strm_out);
+}
 
-    ucall.fval = result.call;
-    uput.fval  = result.put;
+// ---------------------------------------------------------------------
+// Top
+// ---------------------------------------------------------------------
+void dut(hls::stream<bit32_t> &strm_in, hls::stream<bit32_t> &strm_out, hls::stream<bit32_t> &strm_bbo
+         COLD_STORE_PORTS) {
+#if COLD_STORE
+    #pragma HLS INTERFACE m_axi port=cold_orders offset=slave bundle=cold latency=64
+    #pragma HLS INTERFACE m_axi port=cold_index  offset=slave bundle=cold latency=64
+#endif
+#pragma HLS DATAFLOW
 
-    bit32_t icall = static_cast<bit32_t>(ucall.ival);
-    bit32_t iput  = static_cast<bit32_t>(uput.ival);
+    hls::stream<bit32_t> job;
+    #pragma HLS STREAM variable=job depth=JOB_DEPTH
 
-    // Write output to stream (call, put)
-    strm_out.write(icall);
-    strm_out.write(iput);
-}
\ No newline at end of file
+    hft_book(strm_in, strm_bbo, job COLD_STORE_ARGS);
+    hft_price(job, strm_out);
+}
@@ -11,9 +11,57 @@
 #include "blackscholes.hpp"
 #include "typedefs.h"
 
-// Top-Level HLS DUT:
-//   - strm_in:  1 x 32-bit word containing float-encoded spot price S
-//   - strm_out: 2 x 32-bit words containing float-encoded call, then put
-void dut(hls::stream<bit32_t> &strm_in, hls::stream<bit32_t> &strm_out);
+// Header word commands (bits 31..24). The low 16 bits carry the message
+// length for HDR_CMD_MSG, the stock locate to bind for HDR_CMD_RESET, the
+// number of contracts for HDR_CMD_CHAIN (with HDR_CHAIN_GREEKS set to add
+// the Greeks to each contract's output), the push period of HDR_CMD_VOL, the
+// number of position updates for HDR_CMD_POSITION, or a token echoed back by
+// HDR_CMD_SYNC.
+#define HDR_CMD_MSG   0x00   // ITCH message follows
+#define HDR_CMD_RESET 0x01   // reset the book; no payload, no output
+#define HDR_CMD_DUMP  0x02   // write a book snapshot to strm_out
+#define HDR_CMD_LOAD  0x03   // snapshot length in words, then the snapshot; rebuild the book, no output
+#define HDR_CMD_SYNC  0x04   // write OUT_TAG_SYNC | token to strm_out and strm_bbo
+#define HDR_CMD_CHAIN 0x05   // contracts follow (CONTRACT_WORDS each); replace the chain, no output
+#define HDR_CMD_PARAMS 0x06  // PARAM_WORDS words follow; set K, r, v, T, no output
+#define HDR_CMD_EXPIRY 0x07  // EXPIRY_WORDS words follow; set the expiry T counts down to, no output
+#define HDR_CMD_VOL    0x08  // push realized vol into v every (bits 15..0) ms of feed time, 0 = never; no output
+#define HDR_CMD_POSITION 0x09  // position updates follow (POSITION_WORDS each); add the risk words, no output
+#define HDR_CMD_STATS  0x0A  // write the book's storage report (STATS_WORDS words) to strm_out
+
+#define HDR_CHAIN_GREEKS (1 << 16)
+
+// Set in the tag word of a sync marker; clear in result tags
+#define OUT_TAG_SYNC  0x80000000
+
+// Words after the tag of a top-of-book update: bid, bid shares, ask, ask
+// shares (a price is 0 when its side is empty)
+#define BBO_WORDS     4
+
+// Top-Level HLS DUT, one command per call:
+//   - strm_in:  a header word (HDR_CMD_* in bits 31..24), then its payload;
+//               for HDR_CMD_MSG the ITCH message, four bytes per word,
+//               first byte in bits 31..24
+//   - strm_out: 1 + chain_size() * chain_words() + risk_words() x 32-bit
+//               words containing the sequence tag of the message (see
+//               SEQ_TAG_BITS), then the float-encoded price (and Greeks, see
+//               CHAIN_GREEK_WORDS) of each contract in the option chain, then
+//               the portfolio value, delta and gamma once positions are
+//               loaded, only when the message moved the spot. The default
+//               chain gives tag, call, put. With TAG_SPOT_INVALID set in the
+//               tag there is no valid spot and every word is 0.
+//   - strm_bbo: 1 + BBO_WORDS x 32-bit words containing the sequence tag of
+//               the message, then the top of book, only when the message
+//               changed a touch price or size. Written as soon as the book
+//               is updated, before the chain is priced, so a consumer of
+//               the touch alone never waits on strm_out.
+//   - cold_orders, cold_index: off-chip cold order store, only with
+//               COLD_STORE set (see orderbook.hpp)
+// Inside, the book (parser, orderbook, strm_bbo) and the pricing (clock,
+// volatility, chain, strm_out) are two DATAFLOW processes joined by a
+// stream, so the book can take the next message while the chain of the
+// last one is priced.
+void dut(hls::stream<bit32_t> &strm_in, hls::stream<bit32_t> &strm_out, hls::stream<bit32_t> &strm_bbo
+         COLD_STORE_PORTS);
 
 #endif // HFT_HPP
\ No newline at end of file
@@ -2,17 +2,79 @@
 // hft_test.cpp
 //=========================================================================
 // @brief: testbench for the hft application
+//
+// @usage: ./hft                       replay the whole input file
+//         ./hft --dump N <snapshot>   replay N messages, then dump the book
+//         ./hft --load <snapshot>     warm start: load the book, then replay
+//                                     the file from the snapshot's sequence
+//
+// The top-of-book and result records are then checked against the book
+// alone: orderbook() is reset (or given the same snapshot) and run on the
+// same messages, and each message's records must match its SpotUpdate.
 
 #include "hft.hpp"
 #include "timer.h"
 
+#include <vector>
+
 static const char* INPUT_ITCH_FILE = "./data/12302019/filtered_500";
 
+// Off-chip cold order store (zero-initialized, so every index entry is
+// invalid). Without COLD_STORE the DUT keeps its own on chip and this one
+// only serves the reference replay.
+static ColdOrder      cold_orders[COLD_ORDERS];
+static ColdIndexEntry cold_index[COLD_INDEX_ENTRIES];
+
+// What the DUT wrote for one message
+struct MessageRecords {
+    std::string bytes;              // the ITCH message, without its length
+    bool        bbo;                // a top-of-book record
+    uint32_t    bbo_words[1 + BBO_WORDS];
+    bool        result;             // a result record
+    uint32_t    result_tag;
+};
+
+//------------------------------------------------------------------------
+// Snapshot file helpers (raw 32-bit words, host byte order)
+//------------------------------------------------------------------------
+static void write_snapshot(const char* path, hls::stream<bit32_t>& strm) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) throw std::runtime_error("could not open snapshot for writing");
+    while (!strm.empty()) {
+        uint32_t w = strm.read().to_uint();
+        out.write(reinterpret_cast<const char*>(&w), sizeof(w));
+    }
+}
+
+static std::vector<uint32_t> read_snapshot(const char* path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) throw std::runtime_error("could not open snapshot for reading");
+    std::vector<uint32_t> words;
+    uint32_t w;
+    while (in.read(reinterpret_cast<char*>(&w), sizeof(w))) words.push_back(w);
+    if (words.size() < SNAPSHOT_HEADER_WORDS || words[0] != SNAPSHOT_MAGIC)
+        throw std::runtime_error("not a book snapshot");
+    return words;
+}
+
 //------------------------------------------------------------------------
 // HFT testbench
 //------------------------------------------------------------------------
-int main() {
+int main(int argc, char** argv) {
     try {
+        const char* dump_file = nullptr;
+        const char* load_file = nullptr;
+        uint64_t    dump_at   = 0;
+        if (argc == 4 && std::string(argv[1]) == "--dump") {
+            dump_at   = std::stoull(argv[2]);
+            dump_file = argv[3];
+        } else if (argc == 3 && std::string(argv[1]) == "--load") {
+            load_file = argv[2];
+        } else if (argc != 1) {
+            std::cerr << "usage: " << argv[0] << " [--dump N <snapshot> | --load <snapshot>]\n";
+            return 1;
+        }
+
         // Timer
         Timer timer("hft");
 
@@ -20,14 +82,34 @@ int main() {
 
         hls::stream<bit32_t> in_stream;
         hls::stream<bit32_t> out_stream;
+        hls::stream<bit32_t> bbo_stream;
 
         std::unordered_map<ITCH::MessageType_t, uint64_t> counts;
         uint64_t total = 0;
+        uint64_t results = 0;
+        uint64_t bbo_updates = 0;
+        std::vector<MessageRecords> records;
+        std::vector<uint32_t>       snapshot;
 
         const char* msg = nullptr;
+        uint64_t skipped = 0;
 
         timer.start();
 
+        // Warm start: rebuild the book, then resume the feed where the
+        // snapshot was taken
+        if (load_file) {
+            snapshot = read_snapshot(load_file);
+            bit32_t hdr = 0; hdr(31, 24) = HDR_CMD_LOAD;
+            in_stream.write(hdr);
+            in_stream.write((bit32_t)snapshot.size());
+            for (uint32_t w : snapshot) in_stream.write(w);
+            dut(in_stream, out_stream, bbo_stream COLD_STORE_ARGS);
+
+            uint64_t sequence = ((uint64_t)snapshot[3] << 32) | snapshot[4];
+            while (skipped < sequence && reader.nextMessage()) skipped++;
+        }
+
         while ((msg = reader.nextMessage())) {
             auto t = ITCH::Parser::getDataMessageType(msg);
             counts[t]++; total++;
@@ -50,19 +132,82 @@ int main() {
                 in_stream.write(w);
             }
 
-            dut(in_stream, out_stream);
+            dut(in_stream, out_stream, bbo_stream COLD_STORE_ARGS);
 
-            // Get output
-            float call_hw = bits_to_float(out_stream.read());
-            float put_hw  = bits_to_float(out_stream.read());
+            MessageRecords rec;
+            rec.bytes.assign(msg + 2, msg_len);
 
-            // // ---- PRINTING HERE INFLATES TIMING ----
-            // std::cout << std::fixed << std::setprecision(6);
-            // std::cout << "Call_HW=" << call_hw << " | Put_HW="  << put_hw << "\n";
+            // Top of book, written only when the message changed the touch:
+            // the tag, then bid, bid shares, ask, ask shares
+            rec.bbo = !bbo_stream.empty();
+            if (rec.bbo) {
+                HFT_TEST_BBO: for (int w = 0; w < 1 + BBO_WORDS; w++) rec.bbo_words[w] = bbo_stream.read().to_uint();
+                bbo_updates++;
+            }
+
+            // Get output, written only when the message moved the spot: the
+            // tag, then chain_words() words per contract (call, put for the
+            // default chain) and any risk words
+            rec.result = !out_stream.empty();
+            if (rec.result) {
+                rec.result_tag = out_stream.read().to_uint();
+                HFT_TEST_CHAIN: for (int c = 0; c < chain_size() * chain_words() + risk_words(); c++) {
+                    out_stream.read();
+                }
+                results++;
+            }
+            records.push_back(rec);
+
+            if (dump_file && total == dump_at) break;
+        }
+
+        if (dump_file) {
+            bit32_t hdr = 0; hdr(31, 24) = HDR_CMD_DUMP;
+            in_stream.write(hdr);
+            dut(in_stream, out_stream, bbo_stream COLD_STORE_ARGS);
+            write_snapshot(dump_file, out_stream);
         }
 
         timer.stop();
 
+        // Reference: the book alone from the same start, on the same
+        // messages. A BBO record must carry the message's tag and touch,
+        // and a result's tag must be that of the message's BBO record:
+        // only the trade tape fallback (SPOT_FALLBACK) moves the spot
+        // without the touch, and then the reference must agree.
+        if (load_file) {
+            hls::stream<bit32_t> snap;
+            for (uint32_t w : snapshot) snap.write(w);
+            orderbook_load(snap, (bit32_t)snapshot.size(), cold_orders, cold_index);
+        } else {
+            ParsedMessage reset;
+            reset.type = MSG_RESET;
+            orderbook(&reset, cold_orders, cold_index);
+        }
+        uint64_t bbo_errors = 0, tag_errors = 0, tape_results = 0;
+        HFT_TEST_REF: for (const MessageRecords& rec : records) {
+            char buffer[ITCH_BUFFER_BYTES] = { 0 };
+            memcpy(buffer, rec.bytes.data(), rec.bytes.size());
+            ParsedMessage parsed = parser(buffer);
+            SpotUpdate    ref    = orderbook(&parsed, cold_orders, cold_index);
+
+            uint32_t exp_bbo[1 + BBO_WORDS] = { ref.seq.to_uint(), ref.bid.to_uint(), ref.bidShares.to_uint(),
+                                                ref.ask.to_uint(), ref.askShares.to_uint() };
+            if (rec.bbo != ref.bboChanged ||
+                (rec.bbo && !std::equal(exp_bbo, exp_bbo + 1 + BBO_WORDS, rec.bbo_words))) {
+                bbo_errors++;
+            }
+
+            uint32_t exp_tag = ref.seq.to_uint() | (ref.valid ? 0 : TAG_SPOT_INVALID);
+            if (rec.result != ref.changed || (rec.result && rec.result_tag != exp_tag)) {
+                tag_errors++;
+            } else if (rec.result && !rec.bbo) {
+                tape_results++;
+            } else if (rec.result && (rec.result_tag & (TAG_SPOT_INVALID - 1)) != rec.bbo_words[0]) {
+                tag_errors++;
+            }
+        }
+
     // Summary only
     std::cout << "\n";
     std::cout << "============================================\n";
@@ -70,6 +215,15 @@ int main() {
     std::cout << "============================================\n";
     std::cout << "Input file                  : " << INPUT_ITCH_FILE << "\n";
     std::cout << "Total messages              : " << total << "\n";
+    std::cout << "Results emitted             : " << results << "\n";
+    std::cout << "BBO updates emitted         : " << bbo_updates << "\n";
+    std::cout << "BBO mismatches              : " << bbo_errors << "\n";
+    std::cout << "Result tag mismatches       : " << tag_errors << "\n";
+    std::cout << "Results off the tape        : " << tape_results << "\n";
+    if (load_file)
+        std::cout << "Skipped (snapshot)          : " << skipped << "\n";
+    if (dump_file)
+        std::cout << "Snapshot written to         : " << dump_file << "\n";
     std::cout << "Total bytes read            : " << reader.getTotalBytesRead() << "\n\n";
 
     std::cout << "AddOrder (A)                : " << counts['A'] << "\n";
@@ -80,6 +234,8 @@ int main() {
     std::cout << "OrderReplace (U)            : " << counts['U'] << "\n";
     std::cout << "============================================\n";
 
+    if (bbo_errors || tag_errors) return 1;
+
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
         return 1;
@@ -11,6 +11,28 @@ static inline bit64_t read_u64_be(const char* p) {
     return v;
 }
 
+static inline bit16_t read_u16_be(const char* p) {
+#pragma HLS INLINE
+    bit16_t v = 0;
+    READ_U16_BE: for (int i = 0; i < 2; ++i) {
+    #pragma HLS UNROLL
+        v <<= 8;
+        v |= (bit16_t)((unsigned char)p[i]);
+    }
+    return v;
+}
+
+static inline ap_uint<48> read_u48_be(const char* p) {
+#pragma HLS INLINE
+    ap_uint<48> v = 0;
+    READ_U48_BE: for (int i = 0; i < 6; ++i) {
+    #pragma HLS UNROLL
+        v <<= 8;
+        v |= (ap_uint<48>)((unsigned char)p[i]);
+    }
+    return v;
+}
+
 static inline bit32_t read_u32_be(const char* p) {
 #pragma HLS INLINE
     bit32_t v = 0;
@@ -30,7 +52,7 @@ void itch_dut(hls::stream<bit32_t> &strm_in, hls::stream<bit32_t> &strm_out) {
     bit16_t msg_len = (bit16_t)hdr(15, 0);
     assert(msg_len == (bit16_t)hdr(15, 0));
 
-    char in_buffer[36];   // 36 bytes is enough for our ITCH msgs
+    char in_buffer[ITCH_BUFFER_BYTES];
     int  idx   = 0;
 
     // Handle variable msg length
@@ -40,7 +62,7 @@ void itch_dut(hls::stream<bit32_t> &strm_in, hls::stream<bit32_t> &strm_out) {
     #pragma HLS PIPELINE II=1
         bit32_t word = strm_in.read();
 
-        if (idx < msg_len){
+        if (idx < msg_len && idx + 4 <= ITCH_BUFFER_BYTES){
             in_buffer[idx++] = (char)word(31,24);
             in_buffer[idx++] = (char)word(23,16);
             in_buffer[idx++] = (char)word(15, 8);
@@ -59,6 +81,7 @@ void itch_dut(hls::stream<bit32_t> &strm_in, hls::stream<bit32_t> &strm_out) {
     bit32_t w0 = 0;
     w0(7,0)   = parsed.type;
     w0(15,8)  = parsed.side;
+    w0(31,16) = parsed.stock_locate;
     strm_out.write(w0);
     strm_out.write((bit32_t)parsed.order_id.range(63,32));
     strm_out.write((bit32_t)parsed.order_id.range(31, 0));
@@ -75,6 +98,8 @@ ParsedMessage parser(char* buffer) {
 
     char msgType = buffer[0];
     out.type = (bit8_t)msgType;
+    out.stock_locate = read_u16_be(buffer + 1);
+    out.timestamp    = read_u48_be(buffer + 5);
 
     switch (msgType) {
 
@@ -95,9 +120,12 @@ ParsedMessage parser(char* buffer) {
     }
 
     // ------ Order Executed With Price ('C') ----------
+    // side carries the printable flag ('Y' / 'N')
     case ITCH::OrderExecutedWithPriceMessageType: {
         out.order_id = read_u64_be(buffer + 11);
         out.shares   = read_u32_be(buffer + 19);
+        out.side     = (bit8_t)buffer[31];
+        out.price    = read_u32_be(buffer + 32);
         break;
     }
 
@@ -123,6 +151,24 @@ ParsedMessage parser(char* buffer) {
         break;
     }
 
+    // ------------- Trade, non-cross ('P') -------------
+    case ITCH::TradeMessageType: {
+        out.order_id = read_u64_be(buffer + 11);
+        out.side     = (bit8_t)buffer[19];
+        out.shares   = read_u32_be(buffer + 20);
+        out.price    = read_u32_be(buffer + 32);
+        break;
+    }
+
+    // ---------------- Cross Trade ('Q') ---------------
+    // 64-bit share count, saturated to 32 bits
+    case ITCH::CrossTradeMessageType: {
+        bit64_t shares = read_u64_be(buffer + 11);
+        out.shares   = (shares.range(63, 32) != 0) ? (bit32_t)0xFFFFFFFF : (bit32_t)shares.range(31, 0);
+        out.price    = read_u32_be(buffer + 27);
+        break;
+    }
+
     default:
         break;
     }
@@ -22,11 +22,15 @@
 
 #include <endian.h>
 
+// Parser input buffer: the longest ITCH message, rounded up to whole words.
+// Longer messages are truncated, shorter ones leave the tail untouched.
+#define ITCH_BUFFER_BYTES (((ITCH::maxITCHMessageSize) + 3) & ~3)
+
 // Top function
 ParsedMessage parser(char* buffer);
 
 // ITCH Parser HLS DUT:
-//   - strm_in:  5 to 9 x 32-bit words containing ITCH messages
+//   - strm_in:  up to ITCH_BUFFER_BYTES/4 x 32-bit words containing ITCH messages
 //   - strm_out: 7 x 32-bit words containing extracted info
 void itch_dut(hls::stream<bit32_t> &strm_in, hls::stream<bit32_t> &strm_out);
 
@@ -48,8 +48,26 @@ int main() {
                 price = (payload[32] << 24) | (payload[33] << 16) | (payload[34] << 8)  | payload[35];
                 break;
             }
+            case 'C': {
+                side = payload[31];
+                shares = (payload[19] << 24) | (payload[20] << 16) | (payload[21] << 8)  | payload[22];
+                price = (payload[32] << 24) | (payload[33] << 16) | (payload[34] << 8)  | payload[35];
+                break;
+            }
+            case 'P': {
+                side = payload[19];
+                shares = (payload[20] << 24) | (payload[21] << 16) | (payload[22] << 8)  | payload[23];
+                price = (payload[32] << 24) | (payload[33] << 16) | (payload[34] << 8)  | payload[35];
+                break;
+            }
+            case 'Q': {
+                shares = (order_id_hi != 0) ? 0xFFFFFFFF : order_id_lo;   // 64-bit shares @11
+                order_id_hi = 0;
+                order_id_lo = 0;
+                price = (payload[27] << 24) | (payload[28] << 16) | (payload[29] << 8)  | payload[30];
+                break;
+            }
             case 'E': 
-            case 'C': 
             case 'X': {
                 shares = (payload[19] << 24) | (payload[20] << 16) | (payload[21] << 8)  | payload[22];
                 break;
@@ -83,6 +101,11 @@ int main() {
             // DUT
             itch_dut(in_stream, out_stream);
 
+            // Timestamp (bytes 5..10), which only reaches the parser's output
+            uint64_t timestamp = 0;
+            for (int i = 5; i < 11; i++) timestamp = (timestamp << 8) | payload[i];
+            if (parser((char*)payload).timestamp != timestamp) errors++;
+
             // Check results
             outfile << "Type " << t << " | ";
             ITCH_TEST_OUT: for (int i = 0; i < 7; i++) {   // read all 7 words to drain the stream
@@ -117,7 +140,9 @@ int main() {
     std::cout << "OrderExecutedWithPrice (C)  : " << counts['C'] << "\n";
     std::cout << "OrderCancel (X)             : " << counts['X'] << "\n";
     std::cout << "OrderDelete (D)             : " << counts['D'] << "\n";
-    std::cout << "OrderReplace (U)            : " << counts['U'] << "\n\n";
+    std::cout << "OrderReplace (U)            : " << counts['U'] << "\n";
+    std::cout << "Trade (P)                   : " << counts['P'] << "\n";
+    std::cout << "CrossTrade (Q)              : " << counts['Q'] << "\n\n";
 
     std::cout << "Error rate                  : " << std::setprecision(4)
               << (100.0 * errors / total) << "%\n";
@@ -1,4 +1,5 @@
 #include "orderbook.hpp"
+#include "price_heap.hpp"
 
 // ===============================================================
 // OrderBook internal data structures
@@ -7,210 +8,1557 @@
 // Index type for arrays (-1 = none)
 typedef ap_int<16> idx_t;
 
+// Order locator (-1 = none): table slot, ORDER_WINDOW + overflow entry, or
+// COLD_LOC + cold index entry
+typedef ap_int<32> loc_t;
+
+// Full-width order, used by the overflow store and when moving orders around
 struct Order {
     order_ref_t referenceNumber;
     shares_t    shares;
     price_t     price;
+    bit8_t      side;
     bool        valid;
 };
 
-#define MAX_ORDERS 4096
+// Order table: a circular window of ORDER_WINDOW slots indexed directly by
+// the low bits of the reference number. NASDAQ hands out references in
+// increasing order, so a live order only collides with an older one once the
+// window has lapped it; that straggler then moves to the overflow store.
+#define ORDER_WINDOW_BITS 14
+#define ORDER_WINDOW      (1 << ORDER_WINDOW_BITS)
+#define OVERFLOW_ORDERS   64
 #define SIDE_BUY   'B'
 #define SIDE_SELL  'S'
 
+// Compact table record (65 bits instead of 129):
+//   - epoch:       low TABLE_EPOCH_BITS of the book epoch the record was
+//                  written in; records from an older epoch read as empty, so
+//                  a reset is one increment.
+//   - refLap:      ref >> ORDER_WINDOW_BITS modulo 2^REF_LAP_BITS; the slot
+//                  index supplies the low bits. Two live orders alias only if
+//                  they are 2^(ORDER_WINDOW_BITS + REF_LAP_BITS) refs apart.
+//   - priceOffset: signed offset of the price's whole ticks from the book's
+//                  price anchor (itself a whole tick), in PRICE_TICK units.
+//   - priceSub:    the sub-penny remainder, price % PRICE_TICK.
+//   - shares:      exact; an order larger than PACKED_SHARES_MAX, or whose
+//                  offset does not fit, goes to the overflow store instead.
+// Share counts only shrink after an add, so a record always stays packable.
+#define TABLE_EPOCH_BITS   12
+#define REF_LAP_BITS       8
+#define PRICE_OFFSET_BITS  16
+#define PRICE_SUB_BITS     7
+#define PACKED_SHARES_BITS 20
+#define PRICE_TICK         100    // $0.01 in ITCH price units
+#define PRICE_OFFSET_MAX   ((1 << (PRICE_OFFSET_BITS - 1)) - 1)
+#define PACKED_SHARES_MAX  ((1 << PACKED_SHARES_BITS) - 1)
+
+// Move the anchor once the touch drifts this many ticks away from it
+#define REBASE_TICKS       (PRICE_OFFSET_MAX / 2)
+
+// Orders within HOT_TICKS of the touch stay on chip. Farther adds, and
+// stragglers the overflow store has no room for, spill to the cold store.
+#define HOT_TICKS          2048
+#define COLD_LOC           (1 << 24)
+
+// Cold levels: cold orders are grouped into price buckets of
+// COLD_BUCKET_TICKS ticks, and each side keeps its non-empty buckets in a
+// heap (see price_heap.hpp), best first, with the ends of the bucket's order
+// list. The cold bounds are the heap tops, and promotion takes up to
+// PROMOTE_BURST orders per message off the best bucket, so neither scans the
+// store. A side holds up to 2^COLD_LEVEL_BITS buckets, covering at least
+// $655 of cold prices.
+#define COLD_LEVEL_BITS    10
+#define COLD_BUCKET_TICKS  64
+#define COLD_BUCKET_PRICE  (COLD_BUCKET_TICKS * PRICE_TICK)
+#define PROMOTE_BURST      4
+
+// Alternate cold bucket: the low reference bits plus this stride times the
+// higher bits, so references that share a primary bucket spread out
+#define COLD_ALT_STRIDE    0x9E37
+
+// Price levels: the best BOOK_LEVELS prices of each side, best first, with
+// the shares and number of orders resting at each. They are kept sorted as
+// orders change. The levels behind them, up to 2^DEEP_LEVEL_BITS per side,
+// are kept in a heap (see price_heap.hpp) with the best on top; when a
+// sorted level closes, the heap top moves up in its place, so the sorted
+// levels stay complete without a rescan. A second heap orders the same
+// levels worst first. When the heap is full the worse of the new level and
+// the worst deep level is dropped, which truncates its side: from then on
+// the side tracks exactly the prices better than the best dropped one,
+// until the orders at untracked prices have all left.
+#define BOOK_LEVELS     16
+#define DEEP_LEVEL_BITS 10
+#define BID 0
+#define ASK 1
+
+// Order queues (L3): the on-chip orders of each tracked level, sorted or in
+// the heap, form a FIFO, linked through a pool with one node per on-chip
+// locator (table slot or ORDER_WINDOW + overflow entry). A node moves with
+// its order, so the pool needs no allocator and unlinking on delete is O(1).
+// Cold orders are not queued; an order promoted from the cold store rejoins
+// at the back. Once a level has had an order in the cold store its queue is
+// no longer in arrival order, and queue positions there read as unknown
+// until the level closes.
+#define QUEUE_NODES (ORDER_WINDOW + OVERFLOW_ORDERS)
+
+#if BOOK_LEVELS < DEPTH_LEVELS
+#error "BOOK_LEVELS must cover DEPTH_LEVELS"
+#endif
+
+typedef ap_uint<TABLE_EPOCH_BITS>   table_epoch_t;
+typedef ap_uint<REF_LAP_BITS>       ref_lap_t;
+typedef ap_int<PRICE_OFFSET_BITS>   price_off_t;
+typedef ap_uint<PRICE_SUB_BITS>     price_sub_t;
+typedef ap_uint<PACKED_SHARES_BITS> packed_shares_t;
+
+struct PackedOrder {
+    table_epoch_t   epoch;
+    ref_lap_t       refLap;
+    packed_shares_t shares;
+    price_off_t     priceOffset;
+    price_sub_t     priceSub;
+    bool            buy;
+    bool            valid;
+};
+
+struct Level {
+    price_t     price;
+    ap_uint<32> shares;
+    ap_uint<24> orders;
+    idx_t       head;     // first queued order's locator (-1 = none)
+    idx_t       tail;
+    bool        inOrder;  // every order is queued, oldest first
+};
+
+struct DeepLevel {
+    heap_key_t                   key;     // heap_key of the price
+    ap_uint<DEEP_LEVEL_BITS + 1> slot;
+    ap_uint<32>                  shares;
+    ap_uint<24>                  orders;
+    idx_t                        head;
+    idx_t                        tail;
+    bool                         inOrder;
+};
+
+// Worst-first mark of a deep level: its key complemented
+struct DeepMark {
+    heap_key_t                   key;
+    ap_uint<DEEP_LEVEL_BITS + 1> slot;
+};
+
+typedef PriceHeap<DeepLevel, DEEP_LEVEL_BITS> DeepLevels;
+typedef PriceHeap<DeepMark, DEEP_LEVEL_BITS>  DeepMarks;
+
+struct ColdLevel {
+    heap_key_t                   key;     // heap_key of the bucket's edge nearest the touch
+    ap_uint<COLD_LEVEL_BITS + 1> slot;
+    cold_pos_t                   head;    // oldest cold order in the bucket
+    cold_pos_t                   tail;
+};
+
+typedef PriceHeap<ColdLevel, COLD_LEVEL_BITS> ColdLevels;
+
+struct QueueLink {
+    idx_t prev;
+    idx_t next;
+};
+
+typedef ap_uint<1> side_idx_t;
+typedef ap_uint<8> level_idx_t;
+
 // ===============================================================
 // OrderBook Class
 // ===============================================================
 
 class OrderBook {
 public:
-    Order bidOrders[MAX_ORDERS];
-    Order askOrders[MAX_ORDERS];
+    PackedOrder orders[ORDER_WINDOW];
+    Order       overflow[OVERFLOW_ORDERS];
+    Level       levels[2][BOOK_LEVELS];
+    DeepLevels  deepLevels[2];
+    DeepMarks   deepWorst[2];
+    QueueLink   queue[QUEUE_NODES];
+
+    // Current epoch; table records and cold index entries from any other
+    // epoch are empty
+    epoch_t epoch;
+
+    // Stock locate the book follows (0 = every message)
+    stock_loc_t boundLocate;
+
+    // ITCH messages received since the last reset, dropped ones included
+    // (snapshot feed offset)
+    ap_uint<64> sequence;
+
+    // Lowest reference number still covered by the window
+    order_ref_t windowBase;
+
+    // Price that table offsets are relative to
+    price_t priceAnchor;
+
+    // Number of live table records (anchor can move freely at zero)
+    ap_uint<ORDER_WINDOW_BITS + 1> tableCount;
+    ap_uint<8>                     overflowCount;
+
+    // Mid of the last BBO, used to classify orders as hot or cold
+    price_t lastTouch;
+
+    // Spot and touch after the previous message, to report only changes
+    price_t  lastSpot;
+    bool     lastValid;
+    price_t  lastBid;
+    price_t  lastAsk;
+    shares_t lastBidShares;
+    shares_t lastAskShares;
+
+    // Prints so far, the fallback spot for a one-sided book
+    TradeTape tape;
+
+    // Cold store occupancy, the cold levels of each side, and the orders
+    // dropped because the store could not take them
+    cold_pos_t  coldCount;
+    ColdLevels  coldLevels[2];
+    ap_uint<32> droppedOrders;
+
+    // Sorted levels in use per side, whether a level was dropped, the best
+    // dropped price and the orders left at untracked prices, the number of
+    // levels dropped since the last reset, and whether one of the top
+    // DEPTH_LEVELS changed since the last quote
+    level_idx_t levelCount[2];
+    bool        truncated[2];
+    price_t     levelBound[2];
+    ap_uint<32> untrackedOrders[2];
+    ap_uint<32> droppedLevels;
+    bool        depthChanged;
 
     OrderBook() {
         init();
     }
 
     void init() {
-        INIT_BID: for (int i = 0; i < MAX_ORDERS; i++) {
-            bidOrders[i].valid = 0;
+        INIT_ORDERS: for (int i = 0; i < ORDER_WINDOW; i++) {
+            orders[i].valid = 0;
         }
-        INIT_ASK: for (int i = 0; i < MAX_ORDERS; i++) {
-            askOrders[i].valid = 0;
+        epoch       = 0;
+        boundLocate = 0;
+        clear_state();
+    }
+
+    /**
+     * Clears everything that is not stored per record. The overflow store
+     * and the levels are fully partitioned, so this is a single cycle.
+     */
+    void clear_state() {
+    #pragma HLS INLINE
+        CLEAR_OVERFLOW: for (int i = 0; i < OVERFLOW_ORDERS; i++) {
+            #pragma HLS UNROLL
+            overflow[i].valid = 0;
         }
+        sequence      = 0;
+        windowBase    = 0;
+        priceAnchor   = 0;
+        tableCount    = 0;
+        overflowCount = 0;
+        lastTouch     = 0;
+        lastSpot      = 0;
+        lastValid     = false;
+        lastBid       = 0;
+        lastAsk       = 0;
+        lastBidShares = 0;
+        lastAskShares = 0;
+        tape.clear();
+        coldCount     = 0;
+        coldLevels[BID].clear();
+        coldLevels[ASK].clear();
+        droppedOrders = 0;
+        levelCount[BID] = 0;
+        levelCount[ASK] = 0;
+        deepLevels[BID].clear();
+        deepLevels[ASK].clear();
+        deepWorst[BID].clear();
+        deepWorst[ASK].clear();
+        truncated[BID]  = false;
+        truncated[ASK]  = false;
+        untrackedOrders[BID] = 0;
+        untrackedOrders[ASK] = 0;
+        droppedLevels   = 0;
+        depthChanged    = false;
     }
 
-    idx_t find_order(order_ref_t ref, Order orders[MAX_ORDERS]) {
-        idx_t result = 0;
+    /**
+     * Empties the book and binds it to a stock locate (0 = every message).
+     * Bumping the epoch retires every table record and cold index entry at
+     * once. The on-chip table is swept when the record epoch wraps, once
+     * every 2^TABLE_EPOCH_BITS resets; the cold index only when the full
+     * epoch does, which no session reaches.
+     */
+    void reset(stock_loc_t locate, ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
+    #pragma HLS INLINE
+        epoch++;
+        if ((table_epoch_t)epoch == 0) {
+            RESET_SWEEP_ORDERS: for (int i = 0; i < ORDER_WINDOW; i++) {
+                #pragma HLS PIPELINE II=1
+                orders[i].valid = 0;
+            }
+        }
+        if (epoch == 0) {
+            RESET_SWEEP_COLD: for (int i = 0; i < COLD_INDEX_ENTRIES; i++) {
+                #pragma HLS PIPELINE II=1
+                cold_index[i].valid = 0;
+            }
+        }
+        boundLocate = locate;
+        clear_state();
+    }
+
+    bool live(const PackedOrder& p) const {
+    #pragma HLS INLINE
+        return p.valid && p.epoch == (table_epoch_t)epoch;
+    }
+
+    bool live(const ColdIndexEntry& e) const {
+    #pragma HLS INLINE
+        return e.valid && e.epoch == epoch;
+    }
+
+    static idx_t window_slot(order_ref_t ref) {
+    #pragma HLS INLINE
+        return (idx_t)ref.range(ORDER_WINDOW_BITS - 1, 0);
+    }
+
+    static ref_lap_t window_lap(order_ref_t ref) {
+    #pragma HLS INLINE
+        return (ref_lap_t)(ref >> ORDER_WINDOW_BITS);
+    }
+
+    // -----------------------------------------------------------
+    // Record packing
+    // -----------------------------------------------------------
+
+    /**
+     * Whole ticks between the anchor and the tick at or below price.
+     */
+    ap_int<34> tick_offset(price_t price) const {
+    #pragma HLS INLINE
+        return (ap_int<34>)(price / PRICE_TICK) - (ap_int<34>)(priceAnchor / PRICE_TICK);
+    }
+
+    /**
+     * Returns true if the order can be stored in a table record.
+     */
+    bool packs(const Order& o) const {
+    #pragma HLS INLINE
+        ap_int<34> ticks = tick_offset(o.price);
+        return ticks >= -PRICE_OFFSET_MAX && ticks <= PRICE_OFFSET_MAX &&
+               o.shares <= PACKED_SHARES_MAX;
+    }
+
+    PackedOrder pack(const Order& o) const {
+    #pragma HLS INLINE
+        PackedOrder p;
+        p.epoch       = (table_epoch_t)epoch;
+        p.refLap      = window_lap(o.referenceNumber);
+        p.shares      = o.shares;
+        p.priceOffset = (price_off_t)tick_offset(o.price);
+        p.priceSub    = o.price % PRICE_TICK;
+        p.buy         = (o.side == SIDE_BUY);
+        p.valid       = o.valid;
+        return p;
+    }
+
+    /**
+     * Rebuilds the full reference from the slot and the stored lap. The
+     * record belongs to the most recent lap at or before the window's end.
+     */
+    Order unpack(idx_t slot, const PackedOrder& p) const {
+    #pragma HLS INLINE
+        order_ref_t newest_lap = (windowBase + (ORDER_WINDOW - 1)) >> ORDER_WINDOW_BITS;
+        ref_lap_t   lag        = (ref_lap_t)newest_lap - p.refLap;
+        order_ref_t lap        = newest_lap - lag;
+
+        Order o;
+        o.referenceNumber = (lap << ORDER_WINDOW_BITS) | (order_ref_t)slot;
+        o.shares = p.shares;
+        o.price  = priceAnchor + (price_t)(p.priceOffset * PRICE_TICK) + p.priceSub;
+        o.side   = p.buy ? SIDE_BUY : SIDE_SELL;
+        o.valid  = live(p);
+        return o;
+    }
+
+    // -----------------------------------------------------------
+    // Cold store
+    // -----------------------------------------------------------
+
+    /**
+     * First index entry of ref's primary (alt = false) or alternate bucket.
+     */
+    static cold_pos_t cold_bucket(order_ref_t ref, bool alt) {
+    #pragma HLS INLINE
+        ap_uint<COLD_INDEX_BITS> b = ref.range(COLD_INDEX_BITS - 1, 0);
+        if (alt) b += (ap_uint<COLD_INDEX_BITS>)((ref >> COLD_INDEX_BITS) * COLD_ALT_STRIDE + 1);
+        return (cold_pos_t)b * COLD_INDEX_WAYS;
+    }
+
+    bool is_hot(price_t price) const {
+    #pragma HLS INLINE
+        if (lastTouch == 0) return true;
+        ap_int<34> dist = (ap_int<34>)price - (ap_int<34>)lastTouch;
+        return dist <= HOT_TICKS * PRICE_TICK && dist >= -(HOT_TICKS * PRICE_TICK);
+    }
+
+    static heap_key_t heap_key(side_idx_t s, price_t price) {
+    #pragma HLS INLINE
+        return (s == BID) ? (heap_key_t)~price : (heap_key_t)price;
+    }
+
+    static price_t key_price(side_idx_t s, heap_key_t key) {
+    #pragma HLS INLINE
+        return (s == BID) ? (price_t)~key : (price_t)key;
+    }
+
+    /**
+     * Key of the cold bucket holding price: its highest price for a bid,
+     * its lowest for an ask.
+     */
+    static heap_key_t cold_key(side_idx_t s, price_t price) {
+    #pragma HLS INLINE
+        price_t low = price - price % COLD_BUCKET_PRICE;
+        return heap_key(s, (s == BID) ? (price_t)(low + (COLD_BUCKET_PRICE - 1)) : low);
+    }
+
+    /**
+     * Edge of the best cold bucket of a side, 0 if it has no cold orders.
+     */
+    price_t cold_best(side_idx_t s) const {
+    #pragma HLS INLINE
+        return coldLevels[s].empty() ? price_t(0) : key_price(s, coldLevels[s].top().key);
+    }
 
-        FIND_ORDER: for (int i = 0; i < MAX_ORDERS; i++) {
+    /**
+     * Returns the cold index entry holding ref, or -1. One burst read per
+     * bucket; the alternate bucket is only read on a miss.
+     */
+    ap_int<32> cold_find(order_ref_t ref, const ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) const {
+    #pragma HLS INLINE
+        ap_int<32> result = -1;
+        COLD_FIND: for (int w = 0; w < 2 * COLD_INDEX_WAYS; w++) {
             #pragma HLS PIPELINE II=1
-            #pragma HLS unroll factor=32
-            idx_t idx_val = (idx_t)i;
-            result |= (orders[i].valid && orders[i].referenceNumber == ref) ? idx_val : (idx_t)0;
+            if (w == COLD_INDEX_WAYS && result != -1) break;
+            cold_pos_t entry = cold_bucket(ref, w >= COLD_INDEX_WAYS) + w % COLD_INDEX_WAYS;
+            ColdIndexEntry e = cold_index[entry];
+            if (live(e) && e.ref == ref) result = entry;
         }
-        if (result != 0) return result;
-        return -1;
+        return result;
     }
 
-    idx_t find_free_order_slot(Order orders[MAX_ORDERS]) {
+    /**
+     * Appends an order to the cold store, at the back of its bucket's list.
+     * The order is dropped, counted and taken off its level if the store
+     * is full, both of its index buckets are, or its side already has
+     * 2^COLD_LEVEL_BITS cold buckets.
+     */
+    void cold_insert(const Order& o, ColdOrder cold_orders[COLD_ORDERS],
+                     ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
     #pragma HLS INLINE
-        FIND_FREE_ORDER_SLOT: for (int i = 0; i < MAX_ORDERS; i++) {
+        ap_int<32> entry = -1;
+        COLD_INSERT: for (int w = 2 * COLD_INDEX_WAYS - 1; w >= 0; w--) {
             #pragma HLS PIPELINE II=1
-            #pragma HLS unroll factor=32
-            if (!orders[i].valid) return i;
+            cold_pos_t e = cold_bucket(o.referenceNumber, w >= COLD_INDEX_WAYS) + w % COLD_INDEX_WAYS;
+            if (!live(cold_index[e])) entry = e;
         }
-        return -1;
+
+        side_idx_t s   = side_index(o.side);
+        heap_key_t key = cold_key(s, o.price);
+        ColdLevels::pos_t lv_pos = coldLevels[s].find(key);
+        bool no_level = (lv_pos == -1 && coldLevels[s].full());
+        if (entry == -1 || coldCount == COLD_ORDERS || no_level) {
+            level_remove(o.side, o.price, o.shares, true);
+            droppedOrders++;
+            return;
+        }
+        level_unorder(s, o.price);
+
+        ColdLevel lv;
+        if (lv_pos == -1) {
+            lv.key  = key;
+            lv.head = COLD_NONE;
+            lv.tail = COLD_NONE;
+        } else {
+            lv = coldLevels[s].heap[lv_pos];
+        }
+
+        ColdOrder c;
+        c.ref    = o.referenceNumber;
+        c.shares = o.shares;
+        c.price  = o.price;
+        c.side   = o.side;
+        c.prev   = lv.tail;
+        c.next   = COLD_NONE;
+        cold_orders[coldCount] = c;
+        if (lv.tail != COLD_NONE) cold_orders[lv.tail].next = coldCount;
+        else                      lv.head = coldCount;
+        lv.tail = coldCount;
+        if (lv_pos == -1) coldLevels[s].push(lv);
+        else              coldLevels[s].update(lv_pos, lv);
+
+        ColdIndexEntry e;
+        e.ref   = o.referenceNumber;
+        e.pos   = coldCount;
+        e.epoch = epoch;
+        e.valid = true;
+        cold_index[entry] = e;
+
+        coldCount++;
     }
 
     /**
-     * Assumes that either bid_slot != -1 or ask_slot != -1
+     * Points the link into a cold record (its predecessor's next, or its
+     * level's head when it is first, and likewise for the successor's prev)
+     * at a new position.
      */
-    Order& get_order(idx_t bid_slot, idx_t ask_slot) {
-        if (bid_slot != -1) {
-            return bidOrders[bid_slot];
+    void cold_relink(const ColdOrder& c, cold_pos_t prev_to, cold_pos_t next_to,
+                     ColdOrder cold_orders[COLD_ORDERS]) {
+    #pragma HLS INLINE
+        side_idx_t s = side_index(c.side);
+        ColdLevels::pos_t lv_pos = coldLevels[s].find(cold_key(s, c.price));
+        ColdLevel lv = coldLevels[s].heap[lv_pos];
+        if (c.prev != COLD_NONE) cold_orders[c.prev].next = prev_to;
+        else                     lv.head = prev_to;
+        if (c.next != COLD_NONE) cold_orders[c.next].prev = next_to;
+        else                     lv.tail = next_to;
+        if (lv.head == COLD_NONE) coldLevels[s].remove(lv_pos);
+        else                      coldLevels[s].update(lv_pos, lv);
+    }
+
+    /**
+     * Removes the order behind a cold index entry. It is unlinked from its
+     * bucket's list, and the last record moves into the hole so the record
+     * array stays dense.
+     */
+    void cold_erase(ap_int<32> entry, ColdOrder cold_orders[COLD_ORDERS],
+                    ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
+    #pragma HLS INLINE
+        cold_pos_t pos  = cold_index[entry].pos;
+        cold_pos_t last = coldCount - 1;
+        cold_index[entry].valid = false;
+
+        ColdOrder gone = cold_orders[pos];
+        cold_relink(gone, gone.next, gone.prev, cold_orders);
+
+        if (pos != last) {
+            ColdOrder moved = cold_orders[last];
+            cold_orders[pos] = moved;
+            cold_relink(moved, pos, pos, cold_orders);
+            cold_index[cold_find(moved.ref, cold_index)].pos = pos;
+        }
+        coldCount--;
+    }
+
+    // -----------------------------------------------------------
+    // Price levels
+    // -----------------------------------------------------------
+
+    static side_idx_t side_index(bit8_t side) {
+    #pragma HLS INLINE
+        return (side == SIDE_BUY) ? BID : ASK;
+    }
+
+    static bool better(side_idx_t s, price_t a, price_t b) {
+    #pragma HLS INLINE
+        return (s == BID) ? a > b : a < b;
+    }
+
+    /**
+     * Returns the sorted level holding price, or -1.
+     */
+    ap_int<9> find_level(side_idx_t s, price_t price) const {
+    #pragma HLS INLINE
+        ap_int<9> pos = -1;
+        LEVEL_MATCH: for (int i = 0; i < BOOK_LEVELS; i++) {
+            #pragma HLS UNROLL
+            if (i < levelCount[s] && levels[s][i].price == price) pos = i;
+        }
+        return pos;
+    }
+
+    static DeepLevel to_deep(side_idx_t s, const Level& lv) {
+    #pragma HLS INLINE
+        DeepLevel d;
+        d.key    = heap_key(s, lv.price);
+        d.shares = lv.shares;
+        d.orders = lv.orders;
+        d.head   = lv.head;
+        d.tail   = lv.tail;
+        d.inOrder = lv.inOrder;
+        return d;
+    }
+
+    static Level from_deep(side_idx_t s, const DeepLevel& d) {
+    #pragma HLS INLINE
+        Level lv;
+        lv.price  = key_price(s, d.key);
+        lv.shares = d.shares;
+        lv.orders = d.orders;
+        lv.head   = d.head;
+        lv.tail   = d.tail;
+        lv.inOrder = d.inOrder;
+        return lv;
+    }
+
+    /**
+     * Adds a level to both deep heaps. Assumes they are not full.
+     */
+    void deep_push(side_idx_t s, const Level& lv) {
+    #pragma HLS INLINE
+        DeepMark m;
+        m.key = ~heap_key(s, lv.price);
+        deepLevels[s].push(to_deep(s, lv));
+        deepWorst[s].push(m);
+    }
+
+    /**
+     * Removes the deep level at heap position pos from both heaps.
+     */
+    void deep_remove(side_idx_t s, DeepLevels::pos_t pos) {
+    #pragma HLS INLINE
+        heap_key_t key = deepLevels[s].heap[pos].key;
+        deepLevels[s].remove(pos);
+        deepWorst[s].remove(deepWorst[s].find(~key));
+    }
+
+    /**
+     * Stops tracking prices no better than price on a side; the level's
+     * orders become untracked.
+     */
+    void level_drop(side_idx_t s, price_t price, ap_uint<24> orders) {
+    #pragma HLS INLINE
+        if (!truncated[s] || better(s, price, levelBound[s])) levelBound[s] = price;
+        truncated[s] = true;
+        untrackedOrders[s] += orders;
+        droppedLevels++;
+    }
+
+    /**
+     * Puts a level behind the sorted ones. If the heap is full, the worse
+     * of the level and the worst deep level is dropped.
+     */
+    void level_defer(side_idx_t s, const Level& lv) {
+    #pragma HLS INLINE
+        if (!deepLevels[s].full()) {
+            deep_push(s, lv);
+            return;
+        }
+        heap_key_t        worst = ~deepWorst[s].top().key;
+        DeepLevels::pos_t pos   = deepLevels[s].find(worst);
+        DeepLevel         d     = deepLevels[s].heap[pos];
+        if (better(s, lv.price, key_price(s, worst))) {
+            deep_remove(s, pos);
+            deep_push(s, lv);
+            level_drop(s, key_price(s, worst), d.orders);
+        } else {
+            level_drop(s, lv.price, lv.orders);
+        }
+    }
+
+    /**
+     * Adds an order's shares to its level. A new level is inserted in
+     * price order among the sorted levels, pushing the last one into the
+     * heap, or goes straight into the heap if it is worse than all of them.
+     * Every sorted level is compared in parallel.
+     */
+    void level_add(bit8_t side, price_t price, shares_t shares) {
+    #pragma HLS INLINE
+        side_idx_t  s     = side_index(side);
+        level_idx_t count = levelCount[s];
+
+        // Levels strictly better than the price come before it
+        level_idx_t pos   = 0;
+        bool        found = false;
+        LEVEL_FIND: for (int i = 0; i < BOOK_LEVELS; i++) {
+            #pragma HLS UNROLL
+            if (i < count) {
+                if (levels[s][i].price == price)         found = true;
+                if (better(s, levels[s][i].price, price)) pos++;
+            }
+        }
+
+        if (found) {
+            levels[s][pos].shares += shares;
+            levels[s][pos].orders++;
+            if (pos < DEPTH_LEVELS) depthChanged = true;
+            return;
+        }
+
+        DeepLevels::pos_t deep = deepLevels[s].find(heap_key(s, price));
+        if (deep != -1) {
+            DeepLevel d = deepLevels[s].heap[deep];
+            d.shares += shares;
+            d.orders++;
+            deepLevels[s].update(deep, d);
+            return;
+        }
+        if (truncated[s] && !better(s, price, levelBound[s])) {
+            untrackedOrders[s]++;
+            return;
+        }
+
+        Level lv;
+        lv.price  = price;
+        lv.shares = shares;
+        lv.orders = 1;
+        lv.head   = -1;
+        lv.tail   = -1;
+        lv.inOrder = true;
+        if (pos == BOOK_LEVELS) {
+            level_defer(s, lv);
+            return;
+        }
+
+        Level last = levels[s][BOOK_LEVELS - 1];
+        LEVEL_INSERT: for (int i = BOOK_LEVELS - 1; i > 0; i--) {
+            #pragma HLS UNROLL
+            if (i > pos) levels[s][i] = levels[s][i - 1];
+        }
+        levels[s][pos] = lv;
+        if (count == BOOK_LEVELS) level_defer(s, last);
+        else                      levelCount[s] = count + 1;
+        if (pos < DEPTH_LEVELS) depthChanged = true;
+    }
+
+    /**
+     * Takes shares off a level; gone means the order left the book. The
+     * level is closed once its last order is gone, and a closed sorted
+     * level is replaced by the heap top. At an untracked price only the
+     * order count is kept; once a side has no untracked orders left, every
+     * price on it is tracked again.
+     */
+    void level_remove(bit8_t side, price_t price, shares_t shares, bool gone) {
+    #pragma HLS INLINE
+        side_idx_t  s     = side_index(side);
+        level_idx_t count = levelCount[s];
+        ap_int<9>   pos   = find_level(s, price);
+
+        if (pos == -1) {
+            DeepLevels::pos_t deep = deepLevels[s].find(heap_key(s, price));
+            if (deep == -1) {
+                if (gone && truncated[s] && !better(s, price, levelBound[s])) {
+                    untrackedOrders[s]--;
+                    if (untrackedOrders[s] == 0) truncated[s] = false;
+                }
+                return;
+            }
+            DeepLevel d = deepLevels[s].heap[deep];
+            d.shares -= (shares > d.shares) ? d.shares : (ap_uint<32>)shares;
+            if (gone) d.orders--;
+            if (d.orders == 0) deep_remove(s, deep);
+            else               deepLevels[s].update(deep, d);
+            return;
+        }
+
+        Level lv = levels[s][pos];
+        lv.shares -= (shares > lv.shares) ? lv.shares : (ap_uint<32>)shares;
+        if (gone) lv.orders--;
+        levels[s][pos] = lv;
+        if (pos < DEPTH_LEVELS) depthChanged = true;
+        if (lv.orders != 0) return;
+
+        LEVEL_CLOSE: for (int i = 0; i < BOOK_LEVELS - 1; i++) {
+            #pragma HLS UNROLL
+            if (i >= pos) levels[s][i] = levels[s][i + 1];
+        }
+        if (!deepLevels[s].empty()) {
+            levels[s][count - 1] = from_deep(s, deepLevels[s].top());
+            deep_remove(s, 0);
+            if (count - 1 < DEPTH_LEVELS) depthChanged = true;
         } else {
-            return askOrders[ask_slot];
+            levelCount[s] = count - 1;
         }
     }
 
+    /**
+     * Whether a price has a level, sorted or in the heap.
+     */
+    bool level_tracked(side_idx_t s, price_t price) const {
+    #pragma HLS INLINE
+        return find_level(s, price) != -1 || deepLevels[s].find(heap_key(s, price)) != -1;
+    }
+
+    /**
+     * Marks an order's level as out of queue order, once the order is in
+     * the cold store.
+     */
+    void level_unorder(side_idx_t s, price_t price) {
+    #pragma HLS INLINE
+        ap_int<9> pos = find_level(s, price);
+        if (pos != -1) {
+            levels[s][pos].inOrder = false;
+            return;
+        }
+        DeepLevels::pos_t deep = deepLevels[s].find(heap_key(s, price));
+        if (deep == -1) return;
+        DeepLevel d = deepLevels[s].heap[deep];
+        d.inOrder = false;
+        deepLevels[s].update(deep, d);
+    }
+
     // -----------------------------------------------------------
-    // Core order operations
+    // Order queues
     // -----------------------------------------------------------
 
-    void add_order_helper(const ParsedMessage& msg, Order orders[MAX_ORDERS]) {
+    /**
+     * Follows an order's queue node from one on-chip locator to another.
+     * from = -1 appends the order at the back of its level, to = -1
+     * unlinks it. Orders at untracked levels are not queued.
+     */
+    void queue_move(const Order& o, idx_t from, idx_t to) {
+    #pragma HLS INLINE
+        if (from == -1 && to == -1) return;
+        side_idx_t s    = side_index(o.side);
+        ap_int<9>  pos  = find_level(s, o.price);
+        DeepLevels::pos_t deep = (pos == -1) ? deepLevels[s].find(heap_key(s, o.price))
+                                             : DeepLevels::pos_t(-1);
+        if (pos == -1 && deep == -1) return;
+        Level lv = (pos != -1) ? levels[s][pos] : from_deep(s, deepLevels[s].heap[deep]);
+
+        QueueLink link;
+        if (from == -1) {
+            link.prev = lv.tail;
+            link.next = -1;
+        } else {
+            link = queue[from];
+        }
+        idx_t at = (to == -1) ? link.next : to;
+        if (link.prev != -1) queue[link.prev].next = at;
+        else                 lv.head = at;
+        if (to == -1) at = link.prev;
+        if (link.next != -1) queue[link.next].prev = at;
+        else                 lv.tail = at;
+        if (to != -1) queue[to] = link;
+
+        if (pos != -1) {
+            levels[s][pos] = lv;
+        } else {
+            DeepLevel d = deepLevels[s].heap[deep];
+            d.head = lv.head;
+            d.tail = lv.tail;
+            deepLevels[s].update(deep, d);
+        }
+    }
+
+    /**
+     * Head of the queue at an order's level, or -1 if the level is not
+     * tracked or its queue is out of order.
+     */
+    idx_t queue_head(const Order& o) const {
     #pragma HLS INLINE
-        idx_t slot = find_free_order_slot(orders);
-        if (slot == -1) return;
-        Order& o = orders[slot];
-        o.referenceNumber = msg.order_id;
-        o.shares = msg.shares;
-        o.price  = msg.price;
-        o.valid = true; 
+        side_idx_t s   = side_index(o.side);
+        ap_int<9>  pos = find_level(s, o.price);
+        if (pos != -1) return levels[s][pos].inOrder ? levels[s][pos].head : idx_t(-1);
+        DeepLevels::pos_t deep = deepLevels[s].find(heap_key(s, o.price));
+        if (deep == -1 || !deepLevels[s].heap[deep].inOrder) return -1;
+        return deepLevels[s].heap[deep].head;
     }
 
-    void add_order(const ParsedMessage& msg) {
-    #pragma HLS INLINE 
-        if (msg.side == SIDE_BUY) {
-            add_order_helper(msg, bidOrders);
+    /**
+     * Shares queued ahead of ref at its price level, or QUEUE_UNKNOWN if
+     * the order is not queued or its place is not known. Walks the queue from
+     * the head.
+     */
+    bit32_t shares_ahead(order_ref_t ref, const ColdOrder cold_orders[COLD_ORDERS],
+                         const ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
+        loc_t loc = find_order(ref, cold_index);
+        if (loc == -1 || loc >= QUEUE_NODES) return QUEUE_UNKNOWN;
+        Order o = load_order(loc, cold_orders, cold_index);
+
+        bit32_t ahead = 0;
+        idx_t   node  = queue_head(o);
+        SHARES_AHEAD: while (node != -1 && node != loc) {
+            #pragma HLS PIPELINE
+            #pragma HLS LOOP_TRIPCOUNT max=QUEUE_NODES
+            ahead += load_order(node, cold_orders, cold_index).shares;
+            node   = queue[node].next;
+        }
+        return (node == -1) ? (bit32_t)QUEUE_UNKNOWN : ahead;
+    }
+
+    // -----------------------------------------------------------
+    // Order storage
+    // -----------------------------------------------------------
+
+    /**
+     * Returns the locator of ref, or -1 if the order is unknown. Table hits
+     * take a single read; the cold store is only probed on a miss.
+     */
+    loc_t find_order(order_ref_t ref, const ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
+    #pragma HLS INLINE
+        idx_t slot = window_slot(ref);
+        if (live(orders[slot]) && orders[slot].refLap == window_lap(ref)) return slot;
+
+        loc_t result = -1;
+        FIND_OVERFLOW: for (int i = 0; i < OVERFLOW_ORDERS; i++) {
+            #pragma HLS UNROLL
+            if (overflow[i].valid && overflow[i].referenceNumber == ref) {
+                result = (loc_t)(ORDER_WINDOW + i);
+            }
+        }
+        if (result != -1 || coldCount == 0) return result;
+
+        ap_int<32> entry = cold_find(ref, cold_index);
+        if (entry != -1) result = COLD_LOC + entry;
+        return result;
+    }
+
+    idx_t find_free_overflow_slot() {
+    #pragma HLS INLINE
+        idx_t result = -1;
+        FIND_FREE_OVERFLOW_SLOT: for (int i = OVERFLOW_ORDERS - 1; i >= 0; i--) {
+            #pragma HLS UNROLL
+            if (!overflow[i].valid) result = i;
+        }
+        return result;
+    }
+
+    /**
+     * Assumes that loc != -1
+     */
+    Order load_order(loc_t loc, const ColdOrder cold_orders[COLD_ORDERS],
+                     const ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) const {
+    #pragma HLS INLINE
+        if (loc < ORDER_WINDOW) {
+            return unpack(loc, orders[loc]);
+        } else if (loc < COLD_LOC) {
+            return overflow[loc - ORDER_WINDOW];
         } else {
-            add_order_helper(msg, askOrders);
+            ColdOrder c = cold_orders[cold_index[loc - COLD_LOC].pos];
+            Order o;
+            o.referenceNumber = c.ref;
+            o.shares = c.shares;
+            o.price  = c.price;
+            o.side   = c.side;
+            o.valid  = true;
+            return o;
         }
     }
 
+    /**
+     * Writes back an order previously read with load_order. Only the share
+     * count may have shrunk, so the record still packs.
+     */
+    void store_order(loc_t loc, const Order& o, ColdOrder cold_orders[COLD_ORDERS],
+                     ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
+    #pragma HLS INLINE
+        if (!o.valid && loc < QUEUE_NODES) queue_move(o, loc, -1);
+        if (loc < ORDER_WINDOW) {
+            orders[loc] = pack(o);
+            if (!o.valid) tableCount--;
+        } else if (loc < COLD_LOC) {
+            overflow[loc - ORDER_WINDOW] = o;
+            if (!o.valid) overflowCount--;
+        } else if (o.valid) {
+            cold_orders[cold_index[loc - COLD_LOC].pos].shares = o.shares;
+        } else {
+            cold_erase(loc - COLD_LOC, cold_orders, cold_index);
+        }
+    }
+
+    /**
+     * Moves an order into the overflow store, or into the cold store when
+     * the overflow store is full. from is the order's current table slot,
+     * or -1 for an order arriving on chip.
+     */
+    void evict_order(const Order& o, idx_t from, ColdOrder cold_orders[COLD_ORDERS],
+                     ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
+    #pragma HLS INLINE
+        idx_t slot = find_free_overflow_slot();
+        if (slot == -1) {
+            queue_move(o, from, -1);
+            cold_insert(o, cold_orders, cold_index);
+            return;
+        }
+        queue_move(o, from, ORDER_WINDOW + slot);
+        overflow[slot] = o;
+        overflowCount++;
+    }
+
+    /**
+     * Places an order on chip: in its table slot when possible, otherwise
+     * in the overflow store.
+     */
+    void place_order(const Order& o, ColdOrder cold_orders[COLD_ORDERS],
+                     ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
+    #pragma HLS INLINE
+        order_ref_t ref = o.referenceNumber;
+
+        // An empty table can take any anchor without a sweep
+        if (tableCount == 0) priceAnchor = o.price - o.price % PRICE_TICK;
+
+        // Advance the window so that it ends at the newest reference
+        if (ref >= windowBase + ORDER_WINDOW) {
+            windowBase = ref - (ORDER_WINDOW - 1);
+        }
+
+        // Inside the window any other occupant of the slot has been lapped.
+        // A reference arriving behind the window only takes a free slot.
+        idx_t slot = window_slot(ref);
+        PackedOrder cur = orders[slot];
+        bool take_slot = packs(o) && (ref >= windowBase || !live(cur));
+        if (take_slot) {
+            if (live(cur)) evict_order(unpack(slot, cur), slot, cold_orders, cold_index);
+            else           tableCount++;
+            orders[slot] = pack(o);
+            queue_move(o, -1, slot);
+        } else {
+            evict_order(o, -1, cold_orders, cold_index);
+        }
+    }
+
+    /**
+     * Re-centres the table offsets on a new anchor. Records whose price no
+     * longer fits are moved out of the table. This sweeps the whole table,
+     * but only runs when the touch has drifted REBASE_TICKS away.
+     */
+    void rebase(price_t anchor, ColdOrder cold_orders[COLD_ORDERS],
+                ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
+        ap_int<34> shift = (ap_int<34>)(anchor / PRICE_TICK) - (ap_int<34>)(priceAnchor / PRICE_TICK);
+        REBASE: for (int i = 0; i < ORDER_WINDOW; i++) {
+            #pragma HLS PIPELINE II=1
+            PackedOrder p = orders[i];
+            if (!live(p)) continue;
+            ap_int<34> off = (ap_int<34>)p.priceOffset - shift;
+            if (off < -PRICE_OFFSET_MAX || off > PRICE_OFFSET_MAX) {
+                evict_order(unpack(i, p), i, cold_orders, cold_index);
+                orders[i].valid = false;
+                tableCount--;
+            } else {
+                orders[i].priceOffset = (price_off_t)off;
+            }
+        }
+        priceAnchor = anchor;
+    }
+
+    /**
+     * Promotes up to PROMOTE_BURST orders from the best cold buckets the
+     * touch has moved close to, oldest first, while the overflow store has
+     * room.
+     */
+    void promote(ColdOrder cold_orders[COLD_ORDERS],
+                 ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
+        PROMOTE: for (int n = 0; n < PROMOTE_BURST; n++) {
+            price_t bid = cold_best(BID);
+            price_t ask = cold_best(ASK);
+            bool hot_bid = bid != 0 && is_hot(bid);
+            bool hot_ask = ask != 0 && is_hot(ask);
+            if (overflowCount == OVERFLOW_ORDERS || (!hot_bid && !hot_ask)) break;
+
+            side_idx_t s = hot_bid ? BID : ASK;
+            ColdOrder  c = cold_orders[coldLevels[s].top().head];
+            Order o;
+            o.referenceNumber = c.ref;
+            o.shares = c.shares;
+            o.price  = c.price;
+            o.side   = c.side;
+            o.valid  = true;
+            cold_erase(cold_find(c.ref, cold_index), cold_orders, cold_index);
+            place_order(o, cold_orders, cold_index);
+        }
+    }
+
+    /**
+     * Called after every message, before the BBO is read.
+     */
+    void refresh_cold(ColdOrder cold_orders[COLD_ORDERS],
+                      ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
+    #pragma HLS INLINE
+        price_t bid  = cold_best(BID);
+        price_t ask  = cold_best(ASK);
+        bool    room = overflowCount < OVERFLOW_ORDERS;
+        bool    near = (bid != 0 && is_hot(bid)) || (ask != 0 && is_hot(ask));
+        if (near && room) promote(cold_orders, cold_index);
+    }
+
+    /**
+     * Called after every message with the current touch.
+     */
+    void track_touch(price_t best_bid, price_t best_ask, ColdOrder cold_orders[COLD_ORDERS],
+                     ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
+    #pragma HLS INLINE
+        price_t touch;
+        if (best_bid != 0 && best_ask != 0) touch = (best_bid + best_ask) >> 1;
+        else if (best_bid != 0)             touch = best_bid;
+        else if (best_ask != 0)             touch = best_ask;
+        else                                touch = 0;
+        lastTouch = touch;
+        if (touch == 0) return;
+
+        ap_int<34> drift = ((ap_int<34>)touch - (ap_int<34>)priceAnchor) / PRICE_TICK;
+        if (drift > REBASE_TICKS || drift < -REBASE_TICKS) {
+            rebase(touch - touch % PRICE_TICK, cold_orders, cold_index);
+        }
+    }
+
+    /**
+     * Reports the spot after a message (see SPOT_ESTIMATOR) and the touch,
+     * and whether each moved since the previous one. The microprice and the
+     * touch sizes are read off level 0, which is kept up to date per order.
+     */
+    SpotUpdate quote(price_t best_bid, price_t best_ask) {
+    #pragma HLS INLINE
+        SpotUpdate update;
+        update.valid = (best_bid != 0 && best_ask != 0);
+    #if SPOT_ESTIMATOR == SPOT_MICROPRICE
+        ap_uint<33> bid_size = levels[BID][0].shares;
+        ap_uint<33> ask_size = levels[ASK][0].shares;
+        ap_uint<33> depth    = bid_size + ask_size;
+        ap_uint<66> weighted = (ap_uint<66>)best_bid * ask_size + (ap_uint<66>)best_ask * bid_size;
+        update.spot = (depth != 0) ? (bit32_t)(weighted / depth) : bit32_t(0);
+    #else
+        update.spot = (best_bid + best_ask) >> 1;  // divide by 2 using shift
+    #endif
+    #if SPOT_FALLBACK != SPOT_FALLBACK_NONE
+    #if SPOT_FALLBACK == SPOT_FALLBACK_VWAP
+        price_t fallback = tape.vwap();
+    #else
+        price_t fallback = tape.last;
+    #endif
+        if (!update.valid && fallback != 0) {
+            update.spot  = fallback;
+            update.valid = true;
+        }
+    #endif
+        if (!update.valid) update.spot = 0;
+
+        update.bid        = best_bid;
+        update.ask        = best_ask;
+        update.bidShares  = (levelCount[BID] != 0) ? (shares_t)levels[BID][0].shares : shares_t(0);
+        update.askShares  = (levelCount[ASK] != 0) ? (shares_t)levels[ASK][0].shares : shares_t(0);
+        update.bboChanged = update.bid != lastBid || update.ask != lastAsk ||
+                            update.bidShares != lastBidShares || update.askShares != lastAskShares;
+
+        update.seq          = sequence.range(SEQ_TAG_BITS - 1, 0);
+        update.changed      = update.spot != lastSpot || update.valid != lastValid;
+        update.depthChanged = depthChanged;
+        lastSpot      = update.spot;
+        lastValid     = update.valid;
+        lastBid       = update.bid;
+        lastAsk       = update.ask;
+        lastBidShares = update.bidShares;
+        lastAskShares = update.askShares;
+        depthChanged  = false;
+        return update;
+    }
+
+    // -----------------------------------------------------------
+    // Core order operations
+    // -----------------------------------------------------------
+
+    void add_order_helper(order_ref_t ref, bit8_t side, shares_t shares, price_t price,
+                          ColdOrder cold_orders[COLD_ORDERS],
+                          ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
+    #pragma HLS INLINE
+        Order o;
+        o.referenceNumber = ref;
+        o.shares = shares;
+        o.price  = price;
+        o.side   = side;
+        o.valid  = true;
+
+        level_add(side, price, shares);
+        if (is_hot(price)) {
+            place_order(o, cold_orders, cold_index);
+        } else {
+            cold_insert(o, cold_orders, cold_index);
+        }
+    }
+
+    void add_order(const ParsedMessage& msg, ColdOrder cold_orders[COLD_ORDERS],
+                   ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
+    #pragma HLS INLINE 
+        bit8_t side = (msg.side == SIDE_BUY) ? SIDE_BUY : SIDE_SELL;
+        add_order_helper(msg.order_id, side, msg.shares, msg.price, cold_orders, cold_index);
+    }
+
     /**
      * Removes some shares from an order. If we removed more shares than 
      * available, delete it too.
      */
-    void remove_order(const ParsedMessage& msg) {
+    void remove_order(const ParsedMessage& msg, ColdOrder cold_orders[COLD_ORDERS],
+                      ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
     #pragma HLS INLINE 
-        idx_t bid_slot = find_order(msg.order_id, bidOrders);
-        idx_t ask_slot = find_order(msg.order_id, askOrders);
-        if (bid_slot == -1 && ask_slot == -1) return;
-        Order& o = get_order(bid_slot, ask_slot);
+        loc_t loc = find_order(msg.order_id, cold_index);
+        if (loc == -1) return;
+        Order o = load_order(loc, cold_orders, cold_index);
 
         shares_t exec = msg.shares;
         if (exec > o.shares) exec = o.shares;
+        if (msg.type == 'E') tape.print(o.price, exec);
         o.shares -= exec;
         if (o.shares == 0) o.valid = false;
+        store_order(loc, o, cold_orders, cold_index);
+        level_remove(o.side, o.price, exec, !o.valid);
+    }
+
+    /**
+     * Puts a print that carries its own price on the tape: a 'C' marked
+     * printable, a 'P' or a 'Q'. 'E' prints at the resting order's price,
+     * in remove_order.
+     */
+    void record_trade(const ParsedMessage& msg) {
+    #pragma HLS INLINE
+        if (msg.type == 'C' && msg.side != 'Y') return;
+        if (msg.price == 0) return;
+        tape.print(msg.price, msg.shares);
     }
 
     /**
      * Delete all shares from an order.
      */
-    void delete_order(const ParsedMessage& msg) {
+    void delete_order(const ParsedMessage& msg, ColdOrder cold_orders[COLD_ORDERS],
+                      ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
     #pragma HLS INLINE
-        idx_t bid_slot = find_order(msg.order_id, bidOrders);
-        idx_t ask_slot = find_order(msg.order_id, askOrders);
-        if (bid_slot == -1 && ask_slot == -1) return;
-        Order& o = get_order(bid_slot, ask_slot);
+        loc_t loc = find_order(msg.order_id, cold_index);
+        if (loc == -1) return;
+        Order o = load_order(loc, cold_orders, cold_index);
         o.valid = false;
+        store_order(loc, o, cold_orders, cold_index);
+        level_remove(o.side, o.price, o.shares, true);
     }
 
-    void replace_order(const ParsedMessage& msg) {
+    /**
+     * Cancels the original order and re-adds it on the same side under the
+     * new reference number.
+     */
+    void replace_order(const ParsedMessage& msg, ColdOrder cold_orders[COLD_ORDERS],
+                       ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
     #pragma HLS INLINE
-        delete_order(msg);
-        add_order(msg);
+        loc_t loc = find_order(msg.order_id, cold_index);
+        if (loc == -1) return;
+        Order o = load_order(loc, cold_orders, cold_index);
+        o.valid = false;
+        store_order(loc, o, cold_orders, cold_index);
+        level_remove(o.side, o.price, o.shares, true);
+        add_order_helper(msg.new_order_id, o.side, msg.shares, msg.price, cold_orders, cold_index);
     }
 
 
     // -----------------------------------------------------------
-    // Queries
+    // Snapshot
     // -----------------------------------------------------------
 
-    price_t getBestBid() const {
+    static void write_order(hls::stream<bit32_t>& out, const Order& o) {
     #pragma HLS INLINE
-        price_t best = 0;
-        BEST_BID: for (int i = 0; i < MAX_ORDERS; i++) {
-            #pragma HLS unroll factor=64
-            if (bidOrders[i].valid && bidOrders[i].price > best) {
-                best = bidOrders[i].price;
+        out.write((bit32_t)o.side);
+        out.write((bit32_t)o.referenceNumber.range(63, 32));
+        out.write((bit32_t)o.referenceNumber.range(31, 0));
+        out.write((bit32_t)o.shares);
+        out.write((bit32_t)o.price);
+    }
+
+    /**
+     * Writes out the on-chip orders queued at a level, oldest first.
+     */
+    void write_queue(hls::stream<bit32_t>& out, idx_t head) {
+    #pragma HLS INLINE
+        idx_t node = head;
+        WRITE_QUEUE: while (node != -1) {
+            #pragma HLS PIPELINE
+            #pragma HLS LOOP_TRIPCOUNT max=QUEUE_NODES
+            write_order(out, (node < ORDER_WINDOW) ? unpack(node, orders[node])
+                                                   : overflow[node - ORDER_WINDOW]);
+            node = queue[node].next;
+        }
+    }
+
+    /**
+     * Writes every live order out. The queued orders go level by level,
+     * each level's queue oldest first, so a load, which queues orders in
+     * the order it reads them, restores time priority. On-chip orders at
+     * untracked prices follow in reference order, then the cold orders.
+     */
+    void write_orders(hls::stream<bit32_t>& out, const ColdOrder cold_orders[COLD_ORDERS]) {
+        WRITE_LEVELS: for (int i = 0; i < 2 * BOOK_LEVELS; i++) {
+            side_idx_t  s = (i < BOOK_LEVELS) ? BID : ASK;
+            level_idx_t l = (i < BOOK_LEVELS) ? i : i - BOOK_LEVELS;
+            if (l < levelCount[s]) write_queue(out, levels[s][l].head);
+        }
+        WRITE_DEEP: for (int i = 0; i < 2 * DeepLevels::CAPACITY; i++) {
+            side_idx_t s = (i < DeepLevels::CAPACITY) ? BID : ASK;
+            int        p = (i < DeepLevels::CAPACITY) ? i : i - DeepLevels::CAPACITY;
+            if (p < deepLevels[s].count) write_queue(out, deepLevels[s].heap[p].head);
+        }
+        WRITE_UNTRACKED: for (int i = 0; i < OVERFLOW_ORDERS + ORDER_WINDOW; i++) {
+            #pragma HLS PIPELINE
+            Order o;
+            if (i < OVERFLOW_ORDERS) {
+                o = overflow[i];
+            } else {
+                idx_t slot = window_slot(windowBase + (i - OVERFLOW_ORDERS));
+                o = unpack(slot, orders[slot]);
             }
+            if (o.valid && !level_tracked(side_index(o.side), o.price)) write_order(out, o);
+        }
+        WRITE_COLD: for (cold_pos_t i = 0; i < coldCount; i++) {
+            #pragma HLS PIPELINE
+            #pragma HLS LOOP_TRIPCOUNT max=COLD_ORDERS
+            ColdOrder c = cold_orders[i];
+            Order o;
+            o.referenceNumber = c.ref;
+            o.shares = c.shares;
+            o.price  = c.price;
+            o.side   = c.side;
+            write_order(out, o);
         }
-        return best;
     }
 
-    price_t getBestAsk() const {
-    #pragma HLS INLINE
-        bool found = false;
-        price_t best = 0;
+    /**
+     * Writes the book out as a snapshot (format in orderbook.hpp). The
+     * level section holds the top DEPTH_LEVELS levels of each side.
+     */
+    void dump(hls::stream<bit32_t>& out, const ColdOrder cold_orders[COLD_ORDERS]) {
+        level_idx_t bid_levels = (levelCount[BID] < DEPTH_LEVELS) ? levelCount[BID] : level_idx_t(DEPTH_LEVELS);
+        level_idx_t ask_levels = (levelCount[ASK] < DEPTH_LEVELS) ? levelCount[ASK] : level_idx_t(DEPTH_LEVELS);
+        ap_uint<32> count      = tableCount + overflowCount + coldCount;
 
-        BEST_ASK: for (int i = 0; i < MAX_ORDERS; i++) {
-            #pragma HLS unroll factor=64
-            if (askOrders[i].valid) {
-                if (!found || askOrders[i].price < best) {
-                    best = askOrders[i].price;
-                    found = true;
-                }
+        out.write(SNAPSHOT_MAGIC);
+        out.write(SNAPSHOT_VERSION);
+        out.write((bit32_t)boundLocate);
+        out.write((bit32_t)sequence.range(63, 32));
+        out.write((bit32_t)sequence.range(31, 0));
+        out.write(getBestBid());
+        out.write(getBestAsk());
+        out.write(bid_levels + ask_levels);
+        out.write(count);
+        DUMP_LEVELS: for (int i = 0; i < 2 * DEPTH_LEVELS; i++) {
+            #pragma HLS PIPELINE
+            side_idx_t  s = (i < DEPTH_LEVELS) ? BID : ASK;
+            level_idx_t l = (i < DEPTH_LEVELS) ? i : i - DEPTH_LEVELS;
+            if (l >= levelCount[s]) continue;
+            out.write((s == BID) ? SIDE_BUY : SIDE_SELL);
+            out.write(levels[s][l].price);
+            out.write(levels[s][l].shares);
+        }
+        write_orders(out, cold_orders);
+    }
+
+    /**
+     * Writes an L2 record (format in orderbook.hpp) for the current book.
+     */
+    void write_depth(hls::stream<bit32_t>& out) const {
+        out.write((bit32_t)sequence.range(SEQ_TAG_BITS - 1, 0));
+        WRITE_DEPTH: for (int i = 0; i < 2 * DEPTH_LEVELS; i++) {
+            #pragma HLS PIPELINE
+            side_idx_t  s = (i < DEPTH_LEVELS) ? BID : ASK;
+            level_idx_t l = (i < DEPTH_LEVELS) ? i : i - DEPTH_LEVELS;
+            bool present  = l < levelCount[s];
+            out.write(present ? (bit32_t)levels[s][l].price  : bit32_t(0));
+            out.write(present ? (bit32_t)levels[s][l].shares : bit32_t(0));
+        }
+    }
+
+    /**
+     * Writes the storage report (format in orderbook.hpp).
+     */
+    void write_stats(hls::stream<bit32_t>& out) const {
+        out.write((bit32_t)tableCount);
+        out.write((bit32_t)overflowCount);
+        out.write((bit32_t)coldCount);
+        out.write((bit32_t)droppedOrders);
+        out.write((bit32_t)droppedLevels);
+    }
+
+    /**
+     * Writes the trade tape report (format in tape.hpp).
+     */
+    void write_tape(hls::stream<bit32_t>& out) const {
+        out.write((bit32_t)tape.last);
+        out.write((bit32_t)tape.volume.range(63, 32));
+        out.write((bit32_t)tape.volume.range(31, 0));
+        out.write((bit32_t)tape.vwap());
+    }
+
+    /**
+     * Resets the book and rebuilds it from a snapshot of the given length
+     * in words, one order record per SNAPSHOT_ORDER_WORDS stream words. The
+     * anchor and the touch are set from the snapshot's BBO first, so orders
+     * land in the right tier. A snapshot whose magic, version or length is
+     * wrong leaves the book empty; all of its words are consumed either
+     * way, so the stream stays in step.
+     */
+    void load(hls::stream<bit32_t>& in, ap_uint<32> words, ColdOrder cold_orders[COLD_ORDERS],
+              ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
+        bit32_t header[SNAPSHOT_HEADER_WORDS];
+        LOAD_HEADER: for (int i = 0; i < SNAPSHOT_HEADER_WORDS; i++) {
+            #pragma HLS PIPELINE II=1
+            header[i] = (i < words) ? in.read() : bit32_t(0);
+        }
+        ap_uint<32> used = (words < SNAPSHOT_HEADER_WORDS) ? words : ap_uint<32>(SNAPSHOT_HEADER_WORDS);
+        ap_uint<32> levels = header[7];
+        ap_uint<32> count  = header[8];
+        ap_uint<64> length = SNAPSHOT_HEADER_WORDS + (ap_uint<64>)levels * SNAPSHOT_LEVEL_WORDS +
+                             (ap_uint<64>)count * SNAPSHOT_ORDER_WORDS;
+        bool ok = header[0] == SNAPSHOT_MAGIC && header[1] == SNAPSHOT_VERSION && length == words;
+
+        reset(ok ? (stock_loc_t)header[2] : stock_loc_t(0), cold_index);
+        if (!ok) {
+            LOAD_DRAIN: for (; used < words; used++) {
+                #pragma HLS PIPELINE II=1
+                in.read();
             }
+            return;
+        }
+
+        sequence.range(63, 32) = header[3];
+        sequence.range(31, 0)  = header[4];
+        price_t bid = header[5];
+        price_t ask = header[6];
+
+        if (bid != 0 && ask != 0) lastTouch = (bid + ask) >> 1;
+        else if (bid != 0)        lastTouch = bid;
+        else                      lastTouch = ask;
+        priceAnchor = lastTouch - lastTouch % PRICE_TICK;
+
+        LOAD_SKIP_LEVELS: for (ap_uint<32> i = 0; i < levels * SNAPSHOT_LEVEL_WORDS; i++) {
+            #pragma HLS PIPELINE II=1
+            in.read();
         }
-        return found ? best : price_t(0);
+
+        // One order per SNAPSHOT_ORDER_WORDS reads: the stream sets the pace
+        LOAD_ORDERS: for (ap_uint<32> i = 0; i < count; i++) {
+            #pragma HLS PIPELINE
+            Order o;
+            o.side = (bit8_t)in.read();
+            o.referenceNumber.range(63, 32) = in.read();
+            o.referenceNumber.range(31, 0)  = in.read();
+            o.shares = in.read();
+            o.price  = in.read();
+            o.valid  = true;
+            level_add(o.side, o.price, o.shares);
+            if (is_hot(o.price)) place_order(o, cold_orders, cold_index);
+            else                 cold_insert(o, cold_orders, cold_index);
+        }
+
+        // Later messages report changes against the loaded book
+        quote(getBestBid(), getBestAsk());
+    }
+
+    // -----------------------------------------------------------
+    // Queries
+    // -----------------------------------------------------------
+
+    price_t getBestBid() const {
+    #pragma HLS INLINE
+        return (levelCount[BID] != 0) ? levels[BID][0].price : price_t(0);
+    }
+
+    price_t getBestAsk() const {
+    #pragma HLS INLINE
+        return (levelCount[ASK] != 0) ? levels[ASK][0].price : price_t(0);
     }
 };
 
 
-void execute_msg(OrderBook& ob, ParsedMessage &msg) {
+void execute_msg(OrderBook& ob, ParsedMessage &msg, ColdOrder cold_orders[COLD_ORDERS],
+                 ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
     #pragma HLS INLINE
+    if (msg.type == MSG_RESET) {
+        ob.reset(msg.stock_locate, cold_index);
+        return;
+    }
+    // Counted before the stock filter: the sequence is a feed offset
+    ob.sequence++;
+    if (ob.boundLocate != 0 && msg.stock_locate != ob.boundLocate) return;
+
     switch (msg.type) {
-        case 'A': ob.add_order (msg); break;
-        case 'E': ob.remove_order  (msg); break;
-        case 'C': ob.remove_order  (msg); break;
-        case 'X': ob.remove_order  (msg); break;
-        case 'D': ob.delete_order   (msg); break;
-        case 'U': ob.replace_order  (msg); break;
+        case 'A': ob.add_order     (msg, cold_orders, cold_index); break;
+        case 'E': ob.remove_order  (msg, cold_orders, cold_index); break;
+        case 'C': ob.record_trade  (msg);
+                  ob.remove_order  (msg, cold_orders, cold_index); break;
+        case 'X': ob.remove_order  (msg, cold_orders, cold_index); break;
+        case 'D': ob.delete_order  (msg, cold_orders, cold_index); break;
+        case 'U': ob.replace_order (msg, cold_orders, cold_index); break;
+        case 'P': ob.record_trade  (msg); break;
+        case 'Q': ob.record_trade  (msg); break;
         default: break;
     }
+    ob.refresh_cold(cold_orders, cold_index);
 }
 
-bit32_t orderbook(ParsedMessage* msg) {
-    #pragma HLS INLINE
+// Book behind orderbook() and the queries and commands below
+static OrderBook hft_book;
 
-    static OrderBook ob;
-    #pragma hls array_partition variable=ob.bidOrders block factor=128
-    #pragma hls array_partition variable=ob.askOrders block factor=128
+SpotUpdate orderbook(ParsedMessage* msg, ColdOrder cold_orders[COLD_ORDERS],
+                     ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
+    #pragma HLS INLINE
+    #pragma hls array_partition variable=hft_book.overflow complete
+    #pragma hls array_partition variable=hft_book.levels complete dim=0
 
-    execute_msg(ob, *msg);
+    execute_msg(hft_book, *msg, cold_orders, cold_index);
 
-    bit32_t best_bid = ob.getBestBid();
-    bit32_t best_ask = ob.getBestAsk();
-    bit32_t avg = (best_bid + best_ask) >> 1;  // divide by 2 using shift
+    bit32_t best_bid = hft_book.getBestBid();
+    bit32_t best_ask = hft_book.getBestAsk();
+    hft_book.track_touch(best_bid, best_ask, cold_orders, cold_index);
+    SpotUpdate update = hft_book.quote(best_bid, best_ask);
 
     // // ---- PRINTING HERE IS NOT SYNTHESIZABLE ----
-    // double price_display = avg / 10000.0;
+    // double price_display = update.spot / 10000.0;
     // std::cout << std::fixed << std::setprecision(4)
     //          << "Spot_Price=" << std::setw(8) << price_display << " | "; 
     
-    return avg;
+    return update;
+}
+
+void orderbook_dump(hls::stream<bit32_t> &strm_out, ColdOrder cold_orders[COLD_ORDERS]) {
+    #pragma HLS INLINE
+    hft_book.dump(strm_out, cold_orders);
+}
+
+void orderbook_load(hls::stream<bit32_t> &strm_in, bit32_t words, ColdOrder cold_orders[COLD_ORDERS],
+                    ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
+    #pragma HLS INLINE
+    hft_book.load(strm_in, words, cold_orders, cold_index);
+}
+
+void orderbook_depth(hls::stream<bit32_t> &strm_out) {
+    #pragma HLS INLINE
+    hft_book.write_depth(strm_out);
+}
+
+bit32_t orderbook_shares_ahead(order_ref_t ref, ColdOrder cold_orders[COLD_ORDERS],
+                               ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]) {
+    #pragma HLS INLINE
+    return hft_book.shares_ahead(ref, cold_orders, cold_index);
+}
+
+void orderbook_tape(hls::stream<bit32_t> &strm_out) {
+    #pragma HLS INLINE
+    hft_book.write_tape(strm_out);
+}
+
+void orderbook_stats(hls::stream<bit32_t> &strm_out) {
+    #pragma HLS INLINE
+    hft_book.write_stats(strm_out);
 }
 
 
 void orderbook_dut(hls::stream<bit32_t> &strm_in,
-                   hls::stream<bit32_t> &strm_out)
+                   hls::stream<bit32_t> &strm_out
+                   COLD_STORE_PORTS)
 {
+#if COLD_STORE
+    #pragma HLS INTERFACE m_axi port=cold_orders offset=slave bundle=cold latency=64
+    #pragma HLS INTERFACE m_axi port=cold_index  offset=slave bundle=cold latency=64
+#else
+    // On-chip cold store
+    static ColdOrder      cold_orders[COLD_ORDERS];
+    static ColdIndexEntry cold_index[COLD_INDEX_ENTRIES];
+#endif
 
     static OrderBook ob;
-    #pragma hls array_partition variable=ob.bidOrders block factor=128
-    #pragma hls array_partition variable=ob.askOrders block factor=128
+    #pragma hls array_partition variable=ob.overflow complete
+    #pragma hls array_partition variable=ob.levels complete dim=0
+
+    // What to write per book change (MSG_OUTPUT_MODE)
+    static bit8_t mode = OUTPUT_SPOT;
 
     // Require 7 words per message
     if (strm_in.size() < 7)
@@ -231,27 +1579,64 @@ void orderbook_dut(hls::stream<bit32_t> &strm_in,
 
     msg.type = (char)w0(7,0); // Msg Type
     msg.side = (char)w0(15,8); // Side
+    msg.stock_locate = w0(31,16); // Stock Locate
 
     // Decode order reference number
     msg.order_id = 0;
     msg.order_id.range(63,32) = w1;
     msg.order_id.range(31, 0) = w2;
 
-    // Replace/cancel new order id fields unused
+    // Decode new order reference number (replace only)
     msg.new_order_id = 0;
+    msg.new_order_id.range(63,32) = w3;
+    msg.new_order_id.range(31, 0) = w4;
 
     // Decode shares + price
     msg.shares = (shares_t)w5;
     msg.price  = (price_t) w6;
 
+    // Control commands
+    if (msg.type == MSG_OUTPUT_MODE) {
+        mode = msg.side;
+        return;
+    }
+    if (msg.type == MSG_QUEUE_POSITION) {
+        strm_out.write(ob.shares_ahead(msg.order_id, cold_orders, cold_index));
+        return;
+    }
+    if (msg.type == MSG_TAPE) {
+        ob.write_tape(strm_out);
+        return;
+    }
+    if (msg.type == MSG_STATS) {
+        ob.write_stats(strm_out);
+        return;
+    }
+    if (msg.type == MSG_SNAPSHOT_DUMP) {
+        ob.dump(strm_out, cold_orders);
+        return;
+    }
+    if (msg.type == MSG_SNAPSHOT_LOAD) {
+        ob.load(strm_in, w5, cold_orders, cold_index);
+        return;
+    }
+
     // Update Orderbook
-    execute_msg(ob, msg);
+    execute_msg(ob, msg, cold_orders, cold_index);
+    if (msg.type == MSG_RESET) return;
 
     // Calculate spot price
     bit32_t bestBid = ob.getBestBid();
     bit32_t bestAsk = ob.getBestAsk();
-    bit32_t spot = (bestBid + bestAsk) >> 1;
+    ob.track_touch(bestBid, bestAsk, cold_orders, cold_index);
+    SpotUpdate update = ob.quote(bestBid, bestAsk);
 
-    // Output spot price
-    strm_out.write(spot);
+    // Output tagged spot price when it moved, or an L2 record when the top
+    // levels did
+    if (mode == OUTPUT_L2) {
+        if (update.depthChanged) ob.write_depth(strm_out);
+    } else if (update.changed) {
+        strm_out.write(update.valid ? update.seq : (bit32_t)(update.seq | TAG_SPOT_INVALID));
+        strm_out.write(update.spot);
+    }
 }
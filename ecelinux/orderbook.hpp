@@ -7,6 +7,7 @@
 #define ORDERBOOK_HPP
 
 #include "typedefs.h"
+#include "tape.hpp"
 
 #include <hls_stream.h>
 #include <ap_int.h>
@@ -16,13 +17,215 @@ typedef ap_uint<16> stock_loc_t;
 typedef ap_uint<64> timestamp_t;
 typedef ap_uint<32> price_t;
 typedef ap_uint<32> shares_t;
+typedef ap_uint<32> cold_pos_t;
+
+// Book epoch, bumped by a reset (see OrderBook::reset). Cold index entries
+// carry all of it, so they are only swept after 2^32 resets.
+#define EPOCH_BITS 32
+typedef ap_uint<EPOCH_BITS> epoch_t;
+
+// Control message types (word 0 type field of orderbook_dut):
+//   - MSG_RESET:          clear the book and bind it to the stock locate in
+//                         the message (0 = follow every message). No output.
+//   - MSG_SNAPSHOT_DUMP:  write a snapshot of the book to strm_out.
+//   - MSG_SNAPSHOT_LOAD:  the snapshot follows the 7-word message, which
+//                         gives its length in words in word 5. The book is
+//                         reset and rebuilt from it. No output.
+//   - MSG_OUTPUT_MODE:    select what is written per book change, from the
+//                         side field: OUTPUT_SPOT or OUTPUT_L2. No output.
+//   - MSG_QUEUE_POSITION: write the shares queued ahead of the order in
+//                         words 1-2 at its price level (or QUEUE_UNKNOWN).
+//   - MSG_TAPE:           write the trade tape report (TAPE_WORDS words).
+//   - MSG_STATS:          write the storage report (STATS_WORDS words).
+#define MSG_RESET          0x01
+#define MSG_SNAPSHOT_DUMP  0x02
+#define MSG_SNAPSHOT_LOAD  0x03
+#define MSG_OUTPUT_MODE    0x04
+#define MSG_QUEUE_POSITION 0x05
+#define MSG_TAPE           0x06
+#define MSG_STATS          0x07
+
+#define OUTPUT_SPOT 0   // tag + spot when the spot moves (default)
+#define OUTPUT_L2   1   // L2 record when any of the top DEPTH_LEVELS levels changes
+
+// L2 record, DEPTH_RECORD_WORDS words: the sequence tag, then DEPTH_LEVELS
+// (price, aggregate shares) pairs for the bid side and as many for the ask
+// side, best level first. Missing levels read as (0, 0).
+#define DEPTH_LEVELS       5
+#define DEPTH_RECORD_WORDS (1 + 4 * DEPTH_LEVELS)
+
+// Storage report, STATS_WORDS words: orders in the table, in the overflow
+// store and in the cold store, orders dropped since the last reset because
+// the cold store could not take them, and price levels dropped since the
+// last reset because the book could not track them (see orderbook.cpp).
+#define STATS_WORDS 5
+
+// Queue position of an order that is unknown, in the cold store, at a
+// level the book does not track, or at a level that has had orders in the
+// cold store
+#define QUEUE_UNKNOWN 0xFFFFFFFF
+
+// Snapshot format, a sequence of 32-bit words:
+//   header  SNAPSHOT_HEADER_WORDS words:
+//             0    SNAPSHOT_MAGIC
+//             1    SNAPSHOT_VERSION
+//             2    bound stock locate
+//             3-4  sequence: ITCH messages received since the last reset (hi, lo)
+//             5    best bid
+//             6    best ask
+//             7    number of levels L
+//             8    number of orders N
+//   levels  L x SNAPSHOT_LEVEL_WORDS words: side, price, aggregate shares;
+//           the top DEPTH_LEVELS levels of each side, bids first
+//   orders  N x SNAPSHOT_ORDER_WORDS words: side, ref (hi, lo), shares, price;
+//           orders at one price in time priority
+// Levels are derived from the orders; a load only consumes the orders. A
+// load is told the snapshot's length and always consumes that many words, so
+// a snapshot with the wrong magic, version or length is skipped whole and
+// leaves the book empty.
+#define SNAPSHOT_MAGIC        0x4F42534E   // "OBSN"
+#define SNAPSHOT_VERSION      1
+#define SNAPSHOT_HEADER_WORDS 9
+#define SNAPSHOT_LEVEL_WORDS  3
+#define SNAPSHOT_ORDER_WORDS  5
+
+// Cold order store. With COLD_STORE set it is off chip, reached through an
+// AXI master: the top functions take both arrays as ports (COLD_STORE_PORTS),
+// which the caller provides with every index entry initially invalid.
+// Without it the top functions keep a smaller store in on-chip memory. The
+// Xillybus board wrapper has no AXI master hookup, so the board build
+// (run_*.tcl) leaves COLD_STORE off; the C simulation targets in the
+// Makefile turn it on.
+//   - cold_orders: dense array of cold orders; the orders in one price
+//                  bucket are linked in arrival order through prev/next
+//                  (COLD_NONE ends the list)
+//   - cold_index:  COLD_INDEX_WAYS-way buckets. An order goes to the bucket
+//                  picked by the low COLD_INDEX_BITS of its reference
+//                  number, or to an alternate bucket hashed from the higher
+//                  bits when that one is full.
+// An order the store cannot take is dropped and counted (MSG_STATS).
+#ifndef COLD_STORE
+#define COLD_STORE 0
+#endif
+
+#if COLD_STORE
+#define COLD_ORDERS        (1 << 20)
+#define COLD_INDEX_BITS    18
+#else
+#define COLD_ORDERS        (1 << 11)
+#define COLD_INDEX_BITS    9
+#endif
+#define COLD_INDEX_WAYS    4
+#define COLD_INDEX_ENTRIES ((1 << COLD_INDEX_BITS) * COLD_INDEX_WAYS)
+#define COLD_NONE          0xFFFFFFFF
+
+struct ColdOrder {
+    order_ref_t ref;
+    shares_t    shares;
+    price_t     price;
+    bit8_t      side;
+    cold_pos_t  prev;
+    cold_pos_t  next;
+};
+
+struct ColdIndexEntry {
+    order_ref_t ref;
+    cold_pos_t  pos;
+    epoch_t     epoch;
+    bool        valid;
+};
+
+// Trailing cold store parameters and arguments of the top functions
+#if COLD_STORE
+#define COLD_STORE_PORTS , ColdOrder cold_orders[COLD_ORDERS], ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]
+#define COLD_STORE_ARGS  , cold_orders, cold_index
+#else
+#define COLD_STORE_PORTS
+#define COLD_STORE_ARGS
+#endif
+
+// Spot estimator, chosen at compile time:
+//   - SPOT_MID:        (best bid + best ask) / 2
+//   - SPOT_MICROPRICE: touch prices weighted by the size on the other side,
+//                      (bid * ask size + ask * bid size) / (bid size + ask size)
+// The spot is valid only while both sides are present. A one-sided or empty
+// book falls back to a trade tape price chosen by SPOT_FALLBACK, once the
+// tape has one:
+//   - SPOT_FALLBACK_NONE: no fallback
+//   - SPOT_FALLBACK_LAST: the last print
+//   - SPOT_FALLBACK_VWAP: the VWAP over the last TAPE_WINDOW prints
+// An invalid spot reads as 0.
+#define SPOT_MID        0
+#define SPOT_MICROPRICE 1
+
+#define SPOT_FALLBACK_NONE 0
+#define SPOT_FALLBACK_LAST 1
+#define SPOT_FALLBACK_VWAP 2
+
+#ifndef SPOT_ESTIMATOR
+#define SPOT_ESTIMATOR SPOT_MID
+#endif
+#ifndef SPOT_FALLBACK
+#define SPOT_FALLBACK SPOT_FALLBACK_LAST
+#endif
+
+// Sequence tags carry the low SEQ_TAG_BITS of the book sequence: the
+// number of ITCH messages received since the last reset, so the first message
+// after a reset is tagged 1. Messages for other stocks, which a bound book
+// drops, are counted too, so a tag and the snapshot's sequence are offsets
+// into the feed as sent: the host matches results to messages by it and
+// resumes a feed after a loaded snapshot by skipping that many messages. TAG_SPOT_INVALID is set in the tag of a spot
+// output whose spot is not valid.
+#define SEQ_TAG_BITS     30
+#define TAG_SPOT_INVALID (1 << SEQ_TAG_BITS)
+
+// Result of one orderbook() call
+struct SpotUpdate {
+    bit32_t  spot;           // estimate chosen by SPOT_ESTIMATOR (0 if invalid)
+    bit32_t  seq;            // sequence tag of the message
+    bool     valid;          // the estimator had the inputs it needs
+    bool     changed;        // spot or validity differs from the previous message's
+    bool     depthChanged;   // one of the top DEPTH_LEVELS levels changed
+    price_t  bid;            // best bid and ask (0: side empty)
+    price_t  ask;
+    shares_t bidShares;      // shares resting at them
+    shares_t askShares;
+    bool     bboChanged;     // bid, ask or their shares differ from the previous message's
+};
 
 // Top function
-bit32_t orderbook(ParsedMessage* msg);
+SpotUpdate orderbook(ParsedMessage* msg, ColdOrder cold_orders[COLD_ORDERS],
+                  ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]);
+
+// Snapshot dump / bulk load of the book behind orderbook()
+void orderbook_dump(hls::stream<bit32_t> &strm_out, ColdOrder cold_orders[COLD_ORDERS]);
+void orderbook_load(hls::stream<bit32_t> &strm_in, bit32_t words, ColdOrder cold_orders[COLD_ORDERS],
+                    ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]);
+
+// L2 record of the book behind orderbook()
+void orderbook_depth(hls::stream<bit32_t> &strm_out);
+
+// Shares queued ahead of an order in the book behind orderbook()
+bit32_t orderbook_shares_ahead(order_ref_t ref, ColdOrder cold_orders[COLD_ORDERS],
+                               ColdIndexEntry cold_index[COLD_INDEX_ENTRIES]);
+
+// Trade tape report of the book behind orderbook()
+void orderbook_tape(hls::stream<bit32_t> &strm_out);
+
+// Storage report of the book behind orderbook()
+void orderbook_stats(hls::stream<bit32_t> &strm_out);
 
 // Orderbook HLS DUT:
-//   - strm_in:  7 x 32-bit words containing extracted info from ITCH msgs
-//   - strm_out: 1 x 32-bit word containing float-encoded spot price S
-void orderbook_dut(hls::stream<bit32_t> &strm_in, hls::stream<bit32_t> &strm_out);
+//   - strm_in:     7 x 32-bit words containing extracted info from ITCH msgs
+//                  (word 0: type [7:0], side [15:8], stock locate [31:16])
+//   - strm_out:    2 x 32-bit words containing the sequence tag and the spot
+//                  price S, only when the message moved the spot (or an L2
+//                  record per change in OUTPUT_L2 mode); a snapshot
+//                  for MSG_SNAPSHOT_DUMP, a tape report for MSG_TAPE, a
+//                  storage report for MSG_STATS, none for MSG_RESET and
+//                  MSG_SNAPSHOT_LOAD
+//   - cold_orders, cold_index: off-chip cold order store (COLD_STORE only)
+void orderbook_dut(hls::stream<bit32_t> &strm_in, hls::stream<bit32_t> &strm_out
+                   COLD_STORE_PORTS);
 
 #endif // ORDERBOOK_HPP
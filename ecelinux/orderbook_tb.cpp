@@ -2,6 +2,9 @@
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <vector>
+#include <map>
+#include <set>
 
 #include "orderbook.hpp"
 
@@ -9,6 +12,260 @@ typedef ap_uint<32> bit32_t;
 
 static const char* INPUT_ORDERBOOK_FILE = "data/ob_20.dat";
 
+#if COLD_STORE
+// Off-chip cold order store (zero-initialized, so every index entry is invalid)
+static ColdOrder      cold_orders[COLD_ORDERS];
+static ColdIndexEntry cold_index[COLD_INDEX_ENTRIES];
+#endif
+
+// Write one 7-word message and run the DUT
+static void send(hls::stream<bit32_t>& in, hls::stream<bit32_t>& out, char type, char side,
+                 uint32_t ref, uint32_t shares, uint32_t price, uint32_t new_ref = 0) {
+    bit32_t w0 = 0;
+    w0(7,0)  = type;
+    w0(15,8) = side;
+    in.write(w0);
+    in.write(0);
+    in.write(ref);
+    in.write(0);
+    in.write(new_ref);
+    in.write(shares);
+    in.write(price);
+    orderbook_dut(in, out COLD_STORE_ARGS);
+}
+
+// ---------------------------------------------------------------
+// Tier stress test: a seeded message stream driven through the DUT in L2
+// mode and through a reference book, compared after every message
+// ---------------------------------------------------------------
+
+#define TICK 100    // $0.01 in ITCH price units
+
+// Book geometry from orderbook.cpp: the order window's slots, and the ticks
+// past which a price no longer fits a table offset from the anchor
+#define WINDOW_SLOTS       16384
+#define PRICE_OFFSET_LIMIT 32768
+
+struct RefOrder {
+    int      side;      // 0 = bid, 1 = ask
+    uint32_t shares;
+    uint32_t price;
+};
+
+// Reference book: every live order, the aggregate shares at each price and
+// the orders resting there
+struct RefBook {
+    std::map<uint32_t, RefOrder>            orders;
+    std::map<uint32_t, uint64_t>            shares[2];
+    std::map<uint32_t, std::set<uint32_t> > refs[2];
+
+    void add(uint32_t ref, int side, uint32_t qty, uint32_t price) {
+        RefOrder o = { side, qty, price };
+        orders[ref] = o;
+        shares[side][price] += qty;
+        refs[side][price].insert(ref);
+    }
+
+    // Takes qty shares off an order, removing it once none are left
+    void take(uint32_t ref, uint32_t qty) {
+        RefOrder& o = orders[ref];
+        if (qty > o.shares) qty = o.shares;
+        o.shares -= qty;
+        shares[o.side][o.price] -= qty;
+        if (o.shares == 0) remove(ref);
+    }
+
+    void remove(uint32_t ref) {
+        RefOrder o = orders[ref];
+        shares[o.side][o.price] -= o.shares;
+        refs[o.side][o.price].erase(ref);
+        if (refs[o.side][o.price].empty()) {
+            shares[o.side].erase(o.price);
+            refs[o.side].erase(o.price);
+        }
+        orders.erase(ref);
+    }
+
+    // Top DEPTH_LEVELS levels of a side, best first (price 0 = none)
+    void depth(int side, uint32_t price[DEPTH_LEVELS], uint64_t size[DEPTH_LEVELS]) const {
+        int l = 0;
+        if (side == 0) {
+            for (std::map<uint32_t, uint64_t>::const_reverse_iterator it = shares[0].rbegin();
+                 it != shares[0].rend() && l < DEPTH_LEVELS; ++it, ++l) {
+                price[l] = it->first;
+                size[l]  = it->second;
+            }
+        } else {
+            for (std::map<uint32_t, uint64_t>::const_iterator it = shares[1].begin();
+                 it != shares[1].end() && l < DEPTH_LEVELS; ++it, ++l) {
+                price[l] = it->first;
+                size[l]  = it->second;
+            }
+        }
+        for (; l < DEPTH_LEVELS; l++) {
+            price[l] = 0;
+            size[l]  = 0;
+        }
+    }
+};
+
+// Drives the stress stream: generates messages, applies them to the DUT
+// and the reference book, and checks the DUT's latest L2 record against the
+// reference after each one
+struct Stress {
+    hls::stream<bit32_t>& in;
+    hls::stream<bit32_t>& out;
+    RefBook               book;
+    std::vector<uint32_t> live;        // live refs, roughly oldest first
+    uint32_t              nextRef;
+    uint32_t              refGap;      // refs advance by 1 to refGap
+    uint32_t              mid;
+    uint32_t              seed;
+    uint32_t              l2[2 * DEPTH_LEVELS][2];
+    int                   messages;
+    int                   errors;
+
+    Stress(hls::stream<bit32_t>& in_, hls::stream<bit32_t>& out_)
+        : in(in_), out(out_), nextRef(1), refGap(2), mid(1000000), seed(12345), messages(0), errors(0) {
+        for (int l = 0; l < 2 * DEPTH_LEVELS; l++) l2[l][0] = l2[l][1] = 0;
+    }
+
+    uint32_t rnd(uint32_t n) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed % n;
+    }
+
+    // Sends one book message and compares the result with the reference
+    void run(char type, char side, uint32_t ref, uint32_t qty, uint32_t price,
+             uint32_t new_ref = 0) {
+        send(in, out, type, side, ref, qty, price, new_ref);
+        messages++;
+        if (!out.empty()) {
+            out.read();
+            for (int l = 0; l < 2 * DEPTH_LEVELS; l++) {
+                l2[l][0] = out.read().to_uint();
+                l2[l][1] = out.read().to_uint();
+            }
+        }
+        bool pass = out.empty();
+        for (int s = 0; s < 2; s++) {
+            uint32_t price_exp[DEPTH_LEVELS];
+            uint64_t size_exp[DEPTH_LEVELS];
+            book.depth(s, price_exp, size_exp);
+            for (int l = 0; l < DEPTH_LEVELS; l++) {
+                const uint32_t* got = l2[s * DEPTH_LEVELS + l];
+                if (got[0] != price_exp[l] || got[1] != size_exp[l]) pass = false;
+            }
+        }
+        if (!pass) {
+            if (errors < 5) std::cout << "Stress message " << messages << " (" << type
+                                      << " ref " << ref << ") | L2 mismatch\n";
+            errors++;
+        }
+    }
+
+    // Adds an order dist ticks behind the touch, with a sub-penny part
+    // one time in fifty and a share count past 2^20 one time in a hundred
+    void add(int side, uint32_t dist) {
+        uint32_t price = (side == 0) ? mid - TICK - dist * TICK : mid + TICK + dist * TICK;
+        if (rnd(50) == 0) price += 1 + rnd(TICK - 1);
+        uint32_t qty = (rnd(100) == 0) ? 1100000 + rnd(2000000) : 1 + rnd(2000);
+        uint32_t ref = nextRef;
+        nextRef += 1 + rnd(refGap);
+        book.add(ref, side, qty, price);
+        live.push_back(ref);
+        run('A', side == 0 ? 'B' : 'S', ref, qty, price);
+    }
+
+    // Picks a live order, usually a recent one
+    size_t pick() {
+        size_t n = live.size();
+        return (rnd(10) < 7 && n > 200) ? n - 1 - rnd(200) : rnd(n);
+    }
+
+    void drop(size_t k) {
+        live[k] = live.back();
+        live.pop_back();
+    }
+
+    // Deletes the live order at k
+    void cancel(size_t k) {
+        uint32_t ref = live[k];
+        book.remove(ref);
+        drop(k);
+        run('D', 0, ref, 0, 0);
+    }
+
+    // One message of the stream: adds near the touch with probability
+    // add_pct, otherwise an execute, cancel, delete or replace
+    void step(uint32_t add_pct) {
+        if (live.empty() || rnd(100) < add_pct) {
+            add(rnd(2), rnd(30));
+            return;
+        }
+        size_t   k   = pick();
+        uint32_t ref = live[k];
+        RefOrder o   = book.orders[ref];
+        uint32_t r   = rnd(100);
+        if (r < 30) {
+            uint32_t qty = 1 + rnd(500);
+            book.take(ref, qty);
+            if (book.orders.count(ref) == 0) drop(k);
+            run(r < 20 ? 'E' : 'X', 0, ref, qty, 0);
+        } else if (r < 90) {
+            cancel(k);
+        } else {
+            uint32_t new_ref = nextRef++;
+            uint32_t qty     = 1 + rnd(900);
+            uint32_t price   = (o.side == 0) ? mid - TICK * (1 + rnd(20)) : mid + TICK * (1 + rnd(20));
+            book.remove(ref);
+            book.add(new_ref, o.side, qty, price);
+            live[k] = new_ref;
+            run('U', 0, ref, qty, price, new_ref);
+        }
+    }
+
+    void forget(uint32_t ref) {
+        book.remove(ref);
+        for (size_t k = 0; k < live.size(); k++) {
+            if (live[k] == ref) {
+                drop(k);
+                break;
+            }
+        }
+    }
+
+    // Moves the touch up a tick, executing the asks it crosses and
+    // cancelling the bids that fall 600 to 1800 ticks behind it, so the
+    // levels stay within what the book tracks. Bids placed farther back
+    // than that stay until they are picked at random.
+    void drift() {
+        mid += TICK;
+        while (!book.shares[1].empty() && book.shares[1].begin()->first <= mid) {
+            uint32_t ref = *book.refs[1].begin()->second.begin();
+            uint32_t qty = book.orders[ref].shares;
+            forget(ref);
+            run('E', 0, ref, qty, 0);
+        }
+        std::map<uint32_t, std::set<uint32_t> >::iterator it =
+            book.refs[0].lower_bound(mid - 1800 * TICK);
+        while (it != book.refs[0].end() && it->first < mid - 600 * TICK) {
+            uint32_t ref = *it->second.begin();
+            forget(ref);
+            run('D', 0, ref, 0, 0);
+            it = book.refs[0].lower_bound(mid - 1800 * TICK);
+        }
+    }
+
+    // Reads the storage report
+    void stats(uint32_t words[STATS_WORDS]) {
+        send(in, out, MSG_STATS, 0, 0, 0, 0);
+        for (int t = 0; t < STATS_WORDS; t++) words[t] = out.read().to_uint();
+    }
+};
+
 // Convert uint32 -> float spot price
 static inline float ticks_to_float(bit32_t x) {
     return (float)x.to_uint() / 10000.0f;
@@ -81,39 +338,316 @@ int main() {
     std::cout << "Loaded " << N << " orderbook messages.\n\n";
 
     int errors = 0;
+    int emitted = 0;
+
+    // Replay the file three times, resetting the book in between. The last
+    // replay runs in L2 output mode.
+    const int REPLAYS = 3;
+    OB_TEST_REPLAY: for (int r = 0; r < REPLAYS; r++) {
+        if (r > 0) {
+            bit32_t reset = 0;
+            reset(7,0) = MSG_RESET;
+            in_stream.write(reset);
+            OB_TEST_RESET: for (int w = 1; w < 7; w++) in_stream.write(0);
+            orderbook_dut(in_stream, out_stream COLD_STORE_ARGS);
+            if (!out_stream.empty()) errors++;
+            std::cout << "-- Reset --\n";
+        }
+        if (r == 2) {
+            bit32_t mode = 0;
+            mode(7,0)  = MSG_OUTPUT_MODE;
+            mode(15,8) = OUTPUT_L2;
+            in_stream.write(mode);
+            OB_TEST_MODE: for (int w = 1; w < 7; w++) in_stream.write(0);
+            orderbook_dut(in_stream, out_stream COLD_STORE_ARGS);
+            std::cout << "-- L2 output --\n";
+        }
+
+        // Spot after the previous message; the book starts empty
+        float spot_prev = 0;
+
+        // Process all messages
+        OB_TEST_MSG: for (int i = 0; i < N; i++) {
+            // Second replay: restart halfway through from a snapshot
+            if (r == 1 && i == N / 2) {
+                bit32_t cmd = 0;
+                cmd(7,0) = MSG_SNAPSHOT_DUMP;
+                in_stream.write(cmd);
+                OB_TEST_DUMP: for (int w = 1; w < 7; w++) in_stream.write(0);
+                orderbook_dut(in_stream, out_stream COLD_STORE_ARGS);
+
+                cmd(7,0) = MSG_RESET;
+                in_stream.write(cmd);
+                OB_TEST_WIPE: for (int w = 1; w < 7; w++) in_stream.write(0);
+                orderbook_dut(in_stream, out_stream COLD_STORE_ARGS);
+
+                std::vector<bit32_t> snapshot;
+                while (!out_stream.empty()) snapshot.push_back(out_stream.read());
+                uint32_t words = snapshot.size();
+
+                // A copy with a bad magic word goes first: the load must
+                // skip all of it and leave the stream at the real one
+                OB_TEST_LOAD: for (int copy = 0; copy < 2; copy++) {
+                    cmd(7,0) = MSG_SNAPSHOT_LOAD;
+                    in_stream.write(cmd);
+                    for (int w = 1; w < 7; w++) in_stream.write(w == 5 ? (bit32_t)words : bit32_t(0));
+                    in_stream.write(copy == 0 ? (bit32_t)~snapshot[0] : snapshot[0]);
+                    for (uint32_t w = 1; w < words; w++) in_stream.write(snapshot[w]);
+                    orderbook_dut(in_stream, out_stream COLD_STORE_ARGS);
+                    if (!in_stream.empty() || !out_stream.empty()) errors++;
+                }
+                std::cout << "-- Snapshot reload (" << words << " words) --\n";
+            }
+
+            // Write message to stream
+            OB_TEST_STREAM: for (int w = 0; w < 7; w++) in_stream.write(msgs[i][w]);
+
+            // Run DUT
+            orderbook_dut(in_stream, out_stream COLD_STORE_ARGS);
+
+            // Output is tagged with the message's sequence number and only
+            // written when the spot moved
+            float spot_exp = Spot_expected[i];
+            bool  pass;
+            std::cout << std::fixed << std::setprecision(3)
+                      << "Msg " << std::left << std::setw(2) << i;
+            if (r == 2 && !out_stream.empty()) {
+                // L2 record: the touch gives the spot, and each side must be
+                // sorted with size behind every level
+                bit32_t tag = out_stream.read();
+                bit32_t price[2][DEPTH_LEVELS], size[2][DEPTH_LEVELS];
+                OB_TEST_DEPTH: for (int l = 0; l < 2 * DEPTH_LEVELS; l++) {
+                    price[l / DEPTH_LEVELS][l % DEPTH_LEVELS] = out_stream.read();
+                    size [l / DEPTH_LEVELS][l % DEPTH_LEVELS] = out_stream.read();
+                }
+                bool  both = (price[0][0] != 0 && price[1][0] != 0);
+                float spot = both ? ticks_to_float((price[0][0] + price[1][0]) >> 1) : 0.0f;
+                pass = (tag == (bit32_t)(i + 1) && spot == spot_exp);
+                for (int l = 0; l < DEPTH_LEVELS; l++) {
+                    for (int s = 0; s < 2; s++) {
+                        if (price[s][l] == 0) continue;
+                        if (size[s][l] == 0) pass = false;
+                        if (l > 0 && (price[s][l-1] == 0 ||
+                                      (s == 0 ? price[s][l] >= price[s][l-1]
+                                              : price[s][l] <= price[s][l-1]))) pass = false;
+                    }
+                }
+                emitted++;
+                std::cout << " | L2 Mid=   " << std::setw(7) << spot;
+            } else if (!out_stream.empty()) {
+                bit32_t tag  = out_stream.read();
+                float   spot = ticks_to_float(out_stream.read());
+                bit32_t tag_exp = (spot_exp != 0) ? (bit32_t)(i + 1) : (bit32_t)((i + 1) | TAG_SPOT_INVALID);
+                pass = (tag == tag_exp && spot == spot_exp);
+                emitted++;
+                std::cout << " | SpotPrice=" << std::setw(7) << spot;
+            } else {
+                pass = (spot_exp == spot_prev);
+                std::cout << " | (no change)      ";
+            }
+            if (!pass) errors++;
+            spot_prev = spot_exp;
+
+            std::cout << "  Exp=" << std::left << std::setw(7) << spot_exp
+                      << " | Status=" << (pass ? "PASS" : "FAIL")
+                      << "\n";
+        }
+    }
+
+    // Queue position: three bids at one price, in arrival order
+    std::cout << "-- Queue position --\n";
+    send(in_stream, out_stream, MSG_RESET, 0, 0, 0, 0);
+    send(in_stream, out_stream, 'A', 'B', 1, 100, 1000000);
+    send(in_stream, out_stream, 'A', 'B', 2, 200, 1000000);
+    send(in_stream, out_stream, 'A', 'B', 3, 300, 1000000);
+    send(in_stream, out_stream, 'E', 0, 1, 50, 0);
+    while (!out_stream.empty()) out_stream.read();
+
+    const int QUEUE_CHECKS = 4;
+    uint32_t queue_ref[QUEUE_CHECKS] = { 1, 3, 3, 9 };
+    uint32_t queue_exp[QUEUE_CHECKS] = { 0, 250, 50, QUEUE_UNKNOWN };
+    OB_TEST_QUEUE: for (int q = 0; q < QUEUE_CHECKS; q++) {
+        if (q == 2) send(in_stream, out_stream, 'D', 0, 2, 0, 0);
+        while (!out_stream.empty()) out_stream.read();
+        send(in_stream, out_stream, MSG_QUEUE_POSITION, 0, queue_ref[q], 0, 0);
+        bit32_t ahead = out_stream.read();
+        bool pass = (ahead == queue_exp[q]);
+        if (!pass) errors++;
+        std::cout << "Ref " << queue_ref[q] << " | SharesAhead=" << (int)ahead.to_uint()
+                  << "  Exp=" << (int)queue_exp[q]
+                  << " | Status=" << (pass ? "PASS" : "FAIL") << "\n";
+    }
+
+    // Queue order across a snapshot reload: ref 5 arrives after ref 20000
+    // but sits before it in the table, so the dump must follow the queue
+    std::cout << "-- Queue after reload --\n";
+    send(in_stream, out_stream, MSG_RESET, 0, 0, 0, 0);
+    send(in_stream, out_stream, 'A', 'B', 20000, 100, 1000000);
+    send(in_stream, out_stream, 'A', 'B', 5,     200, 1000000);
+    while (!out_stream.empty()) out_stream.read();
+    send(in_stream, out_stream, MSG_SNAPSHOT_DUMP, 0, 0, 0, 0);
+    std::vector<bit32_t> queue_snap;
+    while (!out_stream.empty()) queue_snap.push_back(out_stream.read());
+    send(in_stream, out_stream, MSG_RESET, 0, 0, 0, 0);
+    bit32_t load = 0;
+    load(7,0) = MSG_SNAPSHOT_LOAD;
+    in_stream.write(load);
+    for (int w = 1; w < 7; w++) in_stream.write(w == 5 ? (bit32_t)queue_snap.size() : bit32_t(0));
+    for (size_t w = 0; w < queue_snap.size(); w++) in_stream.write(queue_snap[w]);
+    orderbook_dut(in_stream, out_stream COLD_STORE_ARGS);
 
-    // Process all messages
-    OB_TEST_MSG: for (int i = 0; i < N; i++) {
-        // Write message to stream
-        OB_TEST_STREAM: for (int w = 0; w < 7; w++) in_stream.write(msgs[i][w]);
+    const int RELOAD_CHECKS = 2;
+    uint32_t reload_ref[RELOAD_CHECKS] = { 20000, 5 };
+    uint32_t reload_exp[RELOAD_CHECKS] = { 0, 100 };
+    OB_TEST_RELOAD: for (int q = 0; q < RELOAD_CHECKS; q++) {
+        while (!out_stream.empty()) out_stream.read();
+        send(in_stream, out_stream, MSG_QUEUE_POSITION, 0, reload_ref[q], 0, 0);
+        bit32_t ahead = out_stream.read();
+        bool pass = (ahead == reload_exp[q]);
+        if (!pass) errors++;
+        std::cout << "Ref " << reload_ref[q] << " | SharesAhead=" << (int)ahead.to_uint()
+                  << "  Exp=" << (int)reload_exp[q]
+                  << " | Status=" << (pass ? "PASS" : "FAIL") << "\n";
+    }
 
-        // Run DUT
-        orderbook_dut(in_stream, out_stream);
+    // Trade tape: an execution at the resting price, a printable and a
+    // non-printable 'C', and a non-cross trade
+    std::cout << "-- Trade tape --\n";
+    send(in_stream, out_stream, MSG_RESET, 0, 0, 0, 0);
+    send(in_stream, out_stream, 'A', 'B', 3, 300, 1000000);
+    send(in_stream, out_stream, 'A', 'B', 1, 100, 1000500);
+    send(in_stream, out_stream, 'E', 0,   3, 100, 0);
+    send(in_stream, out_stream, 'C', 'Y', 1, 50, 1000500);
+    send(in_stream, out_stream, 'C', 'N', 1, 10, 1000700);
+    send(in_stream, out_stream, 'P', 'B', 0, 200, 1001000);
+    while (!out_stream.empty()) out_stream.read();
+    send(in_stream, out_stream, MSG_TAPE, 0, 0, 0, 0);
 
-        // Output spot price
-        bit32_t spot_bits = out_stream.read();
-        float spot = ticks_to_float(spot_bits);
+    const char* tape_name[TAPE_WORDS] = { "Last", "VolumeHi", "VolumeLo", "VWAP" };
+    uint32_t    tape_exp[TAPE_WORDS]  = { 1001000, 0, 350, 1000642 };
+    OB_TEST_TAPE: for (int t = 0; t < TAPE_WORDS; t++) {
+        bit32_t word = out_stream.read();
+        bool pass = (word == tape_exp[t]);
+        if (!pass) errors++;
+        std::cout << std::left << std::setw(8) << tape_name[t] << " | Got=" << word.to_uint()
+                  << "  Exp=" << tape_exp[t]
+                  << " | Status=" << (pass ? "PASS" : "FAIL") << "\n";
+    }
+
+    // Cold store: a touch at $1000 and one far bid per cold bucket. The
+    // bucket past the store's last one cannot be taken; that order is
+    // dropped, counted and off its level.
+    std::cout << "-- Cold store --\n";
+    const uint32_t COLD_TOP = 10000000 - 300000;
+    send(in_stream, out_stream, MSG_RESET, 0, 0, 0, 0);
+    send(in_stream, out_stream, 'A', 'B', 1, 100, 10000000);
+    send(in_stream, out_stream, 'A', 'S', 2, 100, 10000100);
+    OB_TEST_COLD: for (uint32_t k = 0; k <= 1024; k++) {
+        send(in_stream, out_stream, 'A', 'B', 10 + k, 1, COLD_TOP - k * 6400);
+    }
+    while (!out_stream.empty()) out_stream.read();
+    send(in_stream, out_stream, MSG_STATS, 0, 0, 0, 0);
 
-        float spot_exp = Spot_expected[i];
-        bool pass = (spot == spot_exp);
+    const char* stats_name[STATS_WORDS] = { "Table", "Overflow", "Cold", "Dropped", "Levels" };
+    uint32_t    stats_exp[STATS_WORDS]  = { 2, 0, 1024, 1, 0 };
+    OB_TEST_STATS: for (int t = 0; t < STATS_WORDS; t++) {
+        bit32_t word = out_stream.read();
+        bool pass = (word == stats_exp[t]);
         if (!pass) errors++;
+        std::cout << std::left << std::setw(8) << stats_name[t] << " | Got=" << word.to_uint()
+                  << "  Exp=" << stats_exp[t]
+                  << " | Status=" << (pass ? "PASS" : "FAIL") << "\n";
+    }
+
+    // Tier stress: more than ORDER_WINDOW live orders, so the window laps
+    // and evicts stragglers; far asks that spill to the cold store and are
+    // promoted as the touch drifts past HOT_TICKS and rebases the anchor;
+    // then far prices past the 16-bit offset limit. Sub-penny prices and
+    // share counts past 2^20 run throughout. The L2 record is checked
+    // against the reference book after every message, storage between
+    // phases.
+    std::cout << "-- Tier stress --\n";
+    send(in_stream, out_stream, MSG_RESET, 0, 0, 0, 0);
+    send(in_stream, out_stream, MSG_OUTPUT_MODE, OUTPUT_L2, 0, 0, 0);
+    Stress   st(in_stream, out_stream);
+    uint32_t st_stats[STATS_WORDS];
+    int      st_checks = 0;
+    // Checks got == exp, or got >= exp when at_least is set
+    auto st_check = [&](const char* name, uint32_t got, uint32_t exp, bool at_least) {
+        bool pass = at_least ? got >= exp : got == exp;
+        if (!pass) errors++;
+        st_checks++;
+        std::cout << std::left << std::setw(16) << name << " | Got=" << got
+                  << (at_least ? "  Exp>=" : "  Exp=") << exp
+                  << " | Status=" << (pass ? "PASS" : "FAIL") << "\n";
+    };
+    // Every order the reference holds must be in one of the three stores
+    auto st_total = [&](const char* name) {
+        st.stats(st_stats);
+        st_check(name, st_stats[0] + st_stats[1] + st_stats[2], st.book.orders.size(), false);
+    };
+
+    // Consecutive refs, so exactly the orders past WINDOW_SLOTS are lapped:
+    // the overflow store fills and the rest go to the cold store
+    const uint32_t LAPPED = 1000;
+    st.refGap = 1;
+    OB_TEST_LAP: while (st.live.size() < WINDOW_SLOTS + LAPPED) st.step(100);
+    st.refGap = 2;
+    st_total("Lap orders");
+    st_check("Lap overflow", st_stats[1], 64, false);
+    st_check("Lap cold", st_stats[2], LAPPED - 64, true);
+    OB_TEST_TRIM: while (st.live.size() > 800) st.cancel(st.rnd(st.live.size()));
+
+    const uint32_t FAR_ASKS = 400;
+    OB_TEST_SPILL: for (uint32_t k = 0; k < FAR_ASKS; k++) st.add(1, 2100 + st.rnd(900));
+    st_total("Spill orders");
+    st_check("Spill cold", st_stats[2], FAR_ASKS, false);
+
+    // The far asks come within HOT_TICKS after 2000 ticks of drift. The
+    // anchor moves twice, and the second time the bids left 1900 ticks
+    // back from the start no longer fit the table. They are kept off the
+    // live list, so the stream never picks them.
+    const uint32_t KEPT_BIDS = 50;
+    OB_TEST_KEEP: for (uint32_t k = 0; k < KEPT_BIDS; k++) {
+        st.add(0, 1900 + k);
+        st.live.pop_back();
+    }
+    OB_TEST_DRIFT: for (int i = 0; i < 136000; i++) {
+        st.step(60);
+        if (i % 4 == 3) st.drift();
+        if (i == 8000) {
+            st_total("Promote orders");
+            st_check("Promote cold", st_stats[2], 0, false);
+        }
+    }
+    st_total("Rebase orders");
+    st_check("Rebase moved", st_stats[1] + st_stats[2], KEPT_BIDS, true);
 
-        std::cout << std::fixed << std::setprecision(3)
-                  << "Msg " << std::left << std::setw(2) << i
-                  << " | SpotPrice=" << std::setw(7) << spot
-                  << "  Exp=" << std::left << std::setw(7) << spot_exp
-                  << " | Status=" << (pass ? "PASS" : "FAIL")
-                  << "\n";
+    OB_TEST_FAR: for (uint32_t k = 0; k < 600; k++) {
+        if (k % 2) st.add(0, 2100 + st.rnd(15000));
+        else       st.add(1, PRICE_OFFSET_LIMIT + st.rnd(5000));
     }
+    st.book.add(st.nextRef, 0, 100, 50);
+    st.live.push_back(st.nextRef);
+    st.run('A', 'B', st.nextRef++, 100, 50);
+    OB_TEST_TAIL: for (int i = 0; i < 3000; i++) st.step(40);
+    st_total("Far orders");
+    st_check("Far dropped", st_stats[3], 0, false);
+    st_check("Far levels", st_stats[4], 0, false);
+    st_check("Stress L2", st.messages - st.errors, st.messages, false);
+    errors += st.errors;
+    send(in_stream, out_stream, MSG_OUTPUT_MODE, OUTPUT_SPOT, 0, 0, 0);
 
     std::cout << "\n============================================\n";
     std::cout << " OrderBook FPGA Testbench Summary\n";
     std::cout << "============================================\n";
     std::cout << "Input file            : " << INPUT_ORDERBOOK_FILE << "\n";
-    std::cout << "Total messages        : " << N << "\n\n";
+    std::cout << "Total messages        : " << N * REPLAYS << "\n";
+    std::cout << "Outputs emitted       : " << emitted << "\n\n";
 
     std::cout << "Error rate            : " << std::setprecision(4)
-              << (100.0 * errors / N) << "%\n";
+              << (100.0 * errors / (N * REPLAYS + QUEUE_CHECKS + RELOAD_CHECKS + TAPE_WORDS +
+                                  STATS_WORDS + st.messages + st_checks)) << "%\n";
     std::cout << "============================================\n\n";
 
     return 0;
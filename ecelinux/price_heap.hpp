@@ -0,0 +1,245 @@
+//===========================================================================
+// price_heap.hpp
+//===========================================================================
+// @brief: This header file defines an indexed heap of price levels, used by
+//         the orderbook for the levels it keeps off its sorted arrays.
+
+#ifndef PRICE_HEAP_HPP
+#define PRICE_HEAP_HPP
+
+#include "typedefs.h"
+
+#include <ap_int.h>
+
+// Heap key of a price. Bids order highest first and asks lowest first, so
+// bid prices are complemented and the heap always puts the lowest key on top.
+typedef ap_uint<32> heap_key_t;
+
+// Index slots are tagged with the clear count they were written in, so a
+// clear is one increment; the index is only swept when the tag wraps.
+#define HEAP_EPOCH_BITS 8
+
+// ===============================================================
+// PriceHeap Class
+// ===============================================================
+
+// Binary min-heap of up to 2^CAP_BITS entries keyed by price, with a hash
+// index from key to heap position so an entry can be updated or removed
+// without a search. Entry must provide:
+//   - heap_key_t key:  the entry's key, unique in the heap
+//   - slot:            the index slot holding it, kept up to date here
+// The index has twice as many slots as the heap has entries and uses
+// linear probing with backward-shift deletion, so probes stay short and no
+// tombstones build up. Every operation is O(log n) reads and writes.
+template <typename Entry, int CAP_BITS>
+class PriceHeap {
+public:
+    static const int CAPACITY   = 1 << CAP_BITS;
+    static const int INDEX_BITS = CAP_BITS + 1;
+    static const int INDEX_SIZE = 1 << INDEX_BITS;
+
+    typedef ap_int<CAP_BITS + 2>    pos_t;    // -1 = none
+    typedef ap_uint<INDEX_BITS>     slot_t;
+    typedef ap_uint<HEAP_EPOCH_BITS> tag_t;
+
+    struct IndexSlot {
+        heap_key_t        key;
+        ap_uint<CAP_BITS> pos;
+        tag_t             tag;
+        bool              valid;
+    };
+
+    Entry     heap[CAPACITY];
+    IndexSlot index[INDEX_SIZE];
+    ap_uint<CAP_BITS + 1> count;
+    tag_t     tag;
+
+    PriceHeap() {
+        INIT_HEAP_INDEX: for (int i = 0; i < INDEX_SIZE; i++) {
+            index[i].valid = false;
+        }
+        tag   = 0;
+        count = 0;
+    }
+
+    /**
+     * Empties the heap.
+     */
+    void clear() {
+    #pragma HLS INLINE
+        tag++;
+        if (tag == 0) {
+            HEAP_SWEEP: for (int i = 0; i < INDEX_SIZE; i++) {
+                #pragma HLS PIPELINE II=1
+                index[i].valid = false;
+            }
+        }
+        count = 0;
+    }
+
+    bool empty() const {
+    #pragma HLS INLINE
+        return count == 0;
+    }
+
+    bool full() const {
+    #pragma HLS INLINE
+        return count == CAPACITY;
+    }
+
+    /**
+     * The entry with the lowest key. Assumes the heap is not empty.
+     */
+    const Entry& top() const {
+    #pragma HLS INLINE
+        return heap[0];
+    }
+
+    /**
+     * Returns the heap position of key, or -1.
+     */
+    pos_t find(heap_key_t key) const {
+    #pragma HLS INLINE
+        slot_t i = hash(key);
+        pos_t  result = -1;
+        HEAP_FIND: for (int n = 0; n < INDEX_SIZE; n++) {
+            #pragma HLS PIPELINE II=1
+            #pragma HLS LOOP_TRIPCOUNT max=4
+            IndexSlot e = index[i];
+            if (!live(e)) break;
+            if (e.key == key) {
+                result = e.pos;
+                break;
+            }
+            i++;
+        }
+        return result;
+    }
+
+    /**
+     * Adds an entry whose key is not in the heap yet. Returns false if the
+     * heap is full.
+     */
+    bool push(Entry e) {
+    #pragma HLS INLINE
+        if (full()) return false;
+        slot_t i = hash(e.key);
+        HEAP_PROBE: for (int n = 0; n < INDEX_SIZE; n++) {
+            #pragma HLS PIPELINE II=1
+            #pragma HLS LOOP_TRIPCOUNT max=4
+            if (!live(index[i])) break;
+            i++;
+        }
+        index[i].key   = e.key;
+        index[i].tag   = tag;
+        index[i].valid = true;
+        e.slot = i;
+        pos_t pos = count;
+        count++;
+        sift_up(pos, e);
+        return true;
+    }
+
+    /**
+     * Writes back an entry read at pos. Its key must be unchanged.
+     */
+    void update(pos_t pos, const Entry& e) {
+    #pragma HLS INLINE
+        heap[pos] = e;
+    }
+
+    /**
+     * Removes the entry at pos; the last entry takes its place.
+     */
+    void remove(pos_t pos) {
+    #pragma HLS INLINE
+        unindex(heap[pos].slot);
+        count--;
+        if (pos == (pos_t)count) return;
+        Entry last = heap[count];
+        if (pos > 0 && last.key < heap[(pos - 1) >> 1].key) sift_up(pos, last);
+        else                                                sift_down(pos, last);
+    }
+
+private:
+    static slot_t hash(heap_key_t key) {
+    #pragma HLS INLINE
+        ap_uint<32> h = key * (ap_uint<32>)0x9E3779B1;
+        return (slot_t)(h >> (32 - INDEX_BITS));
+    }
+
+    bool live(const IndexSlot& e) const {
+    #pragma HLS INLINE
+        return e.valid && e.tag == tag;
+    }
+
+    void place(pos_t pos, const Entry& e) {
+    #pragma HLS INLINE
+        heap[pos] = e;
+        index[e.slot].pos = pos;
+    }
+
+    /**
+     * Puts e at pos or above it, moving the parents it beats down.
+     */
+    void sift_up(pos_t pos, const Entry& e) {
+    #pragma HLS INLINE
+        HEAP_SIFT_UP: for (int n = 0; n < CAP_BITS; n++) {
+            #pragma HLS PIPELINE
+            if (pos == 0) break;
+            pos_t parent = (pos - 1) >> 1;
+            Entry p = heap[parent];
+            if (!(e.key < p.key)) break;
+            place(pos, p);
+            pos = parent;
+        }
+        place(pos, e);
+    }
+
+    /**
+     * Puts e at pos or below it, moving the children that beat it up.
+     */
+    void sift_down(pos_t pos, const Entry& e) {
+    #pragma HLS INLINE
+        HEAP_SIFT_DOWN: for (int n = 0; n < CAP_BITS; n++) {
+            #pragma HLS PIPELINE
+            pos_t child = 2 * pos + 1;
+            if (child >= (pos_t)count) break;
+            Entry c = heap[child];
+            if (child + 1 < (pos_t)count && heap[child + 1].key < c.key) {
+                child++;
+                c = heap[child];
+            }
+            if (!(c.key < e.key)) break;
+            place(pos, c);
+            pos = child;
+        }
+        place(pos, e);
+    }
+
+    /**
+     * Frees an index slot, shifting back the entries probed past it.
+     */
+    void unindex(slot_t hole) {
+    #pragma HLS INLINE
+        slot_t j = hole;
+        HEAP_UNINDEX: for (int n = 0; n < INDEX_SIZE; n++) {
+            #pragma HLS PIPELINE
+            #pragma HLS LOOP_TRIPCOUNT max=4
+            j++;
+            IndexSlot e = index[j];
+            if (!live(e)) break;
+            // e may fill the hole unless its home lies in (hole, j]
+            slot_t home = hash(e.key);
+            bool stay = (hole <= j) ? (hole < home && home <= j)
+                                    : (hole < home || home <= j);
+            if (stay) continue;
+            index[hole] = e;
+            heap[e.pos].slot = hole;
+            hole = j;
+        }
+        index[hole].valid = false;
+    }
+};
+
+#endif // PRICE_HEAP_HPP
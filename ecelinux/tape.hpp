@@ -0,0 +1,85 @@
+//===========================================================================
+// tape.hpp
+//===========================================================================
+// @brief: This header file defines the trade tape kept next to the orderbook.
+
+#ifndef TAPE_HPP
+#define TAPE_HPP
+
+#include "typedefs.h"
+
+#include <ap_int.h>
+
+// The VWAP covers the last TAPE_WINDOW prints
+#ifndef TAPE_WINDOW_BITS
+#define TAPE_WINDOW_BITS 6
+#endif
+#define TAPE_WINDOW (1 << TAPE_WINDOW_BITS)
+
+// Tape report (MSG_TAPE), TAPE_WORDS words: last price, cumulative volume
+// (hi, lo), VWAP over the window. Prices are 0 before the first print.
+#define TAPE_WORDS 4
+
+// ===============================================================
+// TradeTape Class
+// ===============================================================
+
+// Prints from executions, trades and crosses. The window is a ring of the
+// last TAPE_WINDOW prints; running sums of notional and shares are updated
+// as a print enters and the oldest one leaves, so nothing is rescanned.
+class TradeTape {
+public:
+    ap_uint<64> notional_ring[TAPE_WINDOW];  // price * shares
+    ap_uint<32> shares_ring[TAPE_WINDOW];
+
+    ap_uint<32>               last;
+    ap_uint<64>               volume;
+    ap_uint<64 + TAPE_WINDOW_BITS> windowNotional;
+    ap_uint<32 + TAPE_WINDOW_BITS> windowShares;
+    ap_uint<TAPE_WINDOW_BITS> head;
+    bool                      full;
+
+    TradeTape() {
+        clear();
+    }
+
+    /**
+     * Empties the tape. The ring entries are only read once the ring has
+     * wrapped, so they need no clearing.
+     */
+    void clear() {
+    #pragma HLS INLINE
+        last           = 0;
+        volume         = 0;
+        windowNotional = 0;
+        windowShares   = 0;
+        head           = 0;
+        full           = false;
+    }
+
+    void print(ap_uint<32> price, ap_uint<32> shares) {
+    #pragma HLS INLINE
+        if (shares == 0) return;
+        ap_uint<64> notional = (ap_uint<64>)price * shares;
+        if (full) {
+            windowNotional -= notional_ring[head];
+            windowShares   -= shares_ring[head];
+        }
+        notional_ring[head] = notional;
+        shares_ring[head]   = shares;
+        windowNotional += notional;
+        windowShares   += shares;
+
+        head++;
+        if (head == 0) full = true;
+        last    = price;
+        volume += shares;
+    }
+
+    ap_uint<32> vwap() const {
+    #pragma HLS INLINE
+        return (windowShares != 0) ? (ap_uint<32>)(windowNotional / windowShares) : ap_uint<32>(0);
+    }
+};
+
+#endif // TAPE_HPP
@@ -20,6 +20,8 @@ typedef ap_uint<64> bit64_t;
 struct ParsedMessage {
     ap_uint<8>  type         = 0;
     ap_uint<8>  side         = 0;
+    ap_uint<16> stock_locate = 0;
+    ap_uint<48> timestamp    = 0;   // nanoseconds since midnight
     ap_uint<64> order_id     = 0;
     ap_uint<64> new_order_id = 0;
     ap_uint<32> shares       = 0;
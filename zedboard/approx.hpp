@@ -0,0 +1 @@
+../ecelinux/approx.hpp
\ No newline at end of file
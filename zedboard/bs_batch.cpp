@@ -0,0 +1 @@
+../ecelinux/bs_batch.cpp
\ No newline at end of file
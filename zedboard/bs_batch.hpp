@@ -0,0 +1 @@
+../ecelinux/bs_batch.hpp
\ No newline at end of file
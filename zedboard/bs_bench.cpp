@@ -0,0 +1 @@
+../ecelinux/bs_bench.cpp
\ No newline at end of file
@@ -2,66 +2,304 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <math.h>
 #include <assert.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <fstream>
+#include <thread>
+#include <vector>
 
-#include "blackscholes.hpp"
-#include "itch.hpp"
-#include "orderbook.hpp"
+#include "hft.hpp"
 #include "timer.h"
 
 #include "itch_reader.hpp"
 
 static const char* INPUT_ITCH_FILE = "./data/12302019/filtered_500";
 
+// Contracts in the FPGA's option chain (the default chain: call, put)
+static const int CHAIN_CONTRACTS = 2;
+
+// Default size of the batches the channels are written and read in, in
+// 32-bit words (--batch)
+static const size_t IO_BATCH_WORDS = 16384;
+
+// Default flush thresholds of the write batch (--flush): a batch also goes
+// out once it holds IO_FLUSH_MESSAGES messages, or once its first message
+// has waited IO_FLUSH_US, so a message never waits on a batch of thousands
+// to fill. 0 turns a threshold off.
+static const int IO_FLUSH_MESSAGES = 64;
+static const int IO_FLUSH_US       = 100;
+
+// Raised by either thread when its channel fails, so the other stops
+// waiting on the FPGA instead of blocking forever: the writer on a full
+// input FIFO nobody will drain, the reader on results that will not come.
+// Both wait in poll() for at most IO_POLL_MS before looking at it.
+static std::atomic<bool> io_stop(false);
+static const int         IO_POLL_MS = 100;
+
+static int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 //--------------------------------------
-// main function
+// Buffered writes to the FPGA: words are packed into one contiguous
+// buffer, in the DUT's layout, and handed to the channel with one write()
+// per batch instead of one per word. A batch goes out when the next words
+// would overflow it, or, checked as each message is ended, when it holds
+// flush_messages messages or its first message is flush_ns old (0: no
+// such threshold).
 //--------------------------------------
-int main(int argc, char **argv) {
-  // Open channels to the FPGA board.
-  // These channels appear as files to the Linux OS
-  int fdr = open("/dev/xillybus_read_32", O_RDONLY);
-  int fdw = open("/dev/xillybus_write_32", O_WRONLY);
+class WordWriter {
+public:
+  WordWriter(int fd, size_t batch_words, int flush_messages, int64_t flush_ns)
+      : fd(fd), batch(batch_words), flush_messages(flush_messages), flush_ns(flush_ns),
+        messages(0), first_ns(0), good(true) {
+    buf.reserve(batch_words);
+  }
 
-  // Check that the channels are correctly opened
-  if ((fdr < 0) || (fdw < 0)) {
-    fprintf(stderr, "Failed to open Xillybus device channels\n");
-    exit(-1);
+  void put(const uint32_t* words, size_t n) {
+    if (buf.size() + n > batch) flush();
+    buf.insert(buf.end(), words, words + n);
   }
 
-  // Timer
-  Timer timer("FPGA Communication");
+  void put(uint32_t word) { put(&word, 1); }
 
-  // Use ITCH Reader to open and parse a data file
-  ITCH::Reader reader(INPUT_ITCH_FILE);
-  if (!reader.isOpen()) {
-      std::cerr << "Failed to open data file: " << INPUT_ITCH_FILE << std::endl;
-      return -1;
+  // The words put since the last call make one message, formatted at
+  // made_ns
+  void end_message(int64_t made_ns) {
+    if (messages++ == 0) first_ns = made_ns;
+    if ((flush_messages > 0 && messages >= flush_messages) ||
+        (flush_ns > 0 && made_ns - first_ns >= flush_ns)) {
+      flush();
+    }
   }
 
-  std::cout << "Sending ITCH messages to FPGA..." << std::endl;
+  // Write out everything buffered (write() may take it in several goes).
+  // The channel is non-blocking: while the FPGA's input FIFO is full the
+  // writer waits in poll(), and gives up once io_stop is raised. Returns
+  // false, then and from then on, if the channel failed or was stopped.
+  bool flush() {
+    const char* src  = reinterpret_cast<const char*>(buf.data());
+    size_t      left = good ? buf.size() * sizeof(uint32_t) : 0;
+    while (left > 0) {
+      if (io_stop.load(std::memory_order_relaxed)) {
+        good = false;
+        break;
+      }
+      ssize_t nbytes = write(fd, src, left);
+      if (nbytes < 0 && (errno == EAGAIN || errno == EINTR)) {
+        struct pollfd p = { fd, POLLOUT, 0 };
+        poll(&p, 1, IO_POLL_MS);
+        continue;
+      }
+      if (nbytes <= 0) {
+        good = false;
+        break;
+      }
+      src  += nbytes;
+      left -= nbytes;
+    }
+    buf.clear();
+    messages = 0;
+    return good;
+  }
+
+  bool ok() const { return good; }
 
+private:
+  int                   fd;
+  size_t                batch;
+  int                   flush_messages;
+  int64_t               flush_ns;
+  int                   messages;   // messages in buf
+  int64_t               first_ns;   // when the first of them was formatted
+  bool                  good;
+  std::vector<uint32_t> buf;
+};
+
+//--------------------------------------
+// Buffered reads from the FPGA: each read() takes up to a batch of
+// whatever the channel has, and words are handed out from the buffer
+//--------------------------------------
+class WordReader {
+public:
+  WordReader(int fd, size_t batch_words) : fd(fd), buf(batch_words * sizeof(uint32_t)), head(0), tail(0) {}
+
+  // A whole word is waiting in the buffer, so next() will not block
+  bool buffered() const { return tail - head >= sizeof(uint32_t); }
+
+  // Read one 32-bit word, refilling the buffer if needed. An empty channel
+  // is waited on in poll(), as in WordWriter::flush(), so the reader gives
+  // up once io_stop is raised. Returns false if the channel failed, ended
+  // or was stopped.
+  bool next(uint32_t* word) {
+    while (tail - head < sizeof(uint32_t)) {
+      memmove(buf.data(), buf.data() + head, tail - head);
+      tail -= head;
+      head  = 0;
+      if (io_stop.load(std::memory_order_relaxed)) return false;
+      struct pollfd p = { fd, POLLIN, 0 };
+      int ready = poll(&p, 1, IO_POLL_MS);
+      if (ready < 0 && errno != EINTR) return false;
+      if (ready <= 0) continue;
+      ssize_t nbytes = read(fd, buf.data() + tail, buf.size() - tail);
+      if (nbytes < 0 && errno == EINTR) continue;
+      if (nbytes <= 0) return false;
+      tail += nbytes;
+    }
+    memcpy(word, buf.data() + head, sizeof(uint32_t));
+    head += sizeof(uint32_t);
+    return true;
+  }
+
+private:
+  int               fd;
+  std::vector<char> buf;
+  size_t            head, tail;
+};
+
+//--------------------------------------
+// Load new pricing parameters (K, r, v, T) into the FPGA. Results of
+// messages sent after this are priced with them.
+//--------------------------------------
+static void send_params(WordWriter& out, const float params[PARAM_WORDS]) {
+  uint32_t words[1 + PARAM_WORDS];
+  words[0] = (uint32_t)HDR_CMD_PARAMS << 24;
+  memcpy(&words[1], params, PARAM_WORDS * sizeof(float));
+  out.put(words, 1 + PARAM_WORDS);
+}
+
+//--------------------------------------
+// Set the expiry the FPGA counts T down to, in nanoseconds on the feed's
+// clock (0 = keep T fixed)
+//--------------------------------------
+static void send_expiry(WordWriter& out, uint64_t expiry_ns) {
+  uint32_t words[1 + EXPIRY_WORDS];
+  words[0] = (uint32_t)HDR_CMD_EXPIRY << 24;
+  words[1] = (uint32_t)(expiry_ns >> 32);
+  words[2] = (uint32_t)expiry_ns;
+  out.put(words, 1 + EXPIRY_WORDS);
+}
+
+//--------------------------------------
+// Set the quantities held of chain contracts; from the next result on, the
+// FPGA follows each with the portfolio value, delta and gamma
+//--------------------------------------
+struct PositionUpdate {
+  long     at;         // messages sent before it
+  uint32_t contract;
+  int32_t  quantity;
+};
+
+static void send_positions(WordWriter& out, const std::vector<PositionUpdate>& updates, long at) {
+  std::vector<uint32_t> words(1);
+  for (const PositionUpdate& p : updates) {
+    if (p.at != at) continue;
+    words.push_back(p.contract);
+    words.push_back((uint32_t)p.quantity);
+  }
+  if (words.size() == 1) return;
+  words[0] = ((uint32_t)HDR_CMD_POSITION << 24) | (uint32_t)((words.size() - 1) / POSITION_WORDS);
+  out.put(words.data(), words.size());
+}
+
+//--------------------------------------
+// Send log: when each of the last SEND_LOG messages went out, by sequence
+// tag (the first message is 1), so the reader can match a result to its
+// message. The writer fills a slot and publishes the tag before the
+// message is written; a slot the writer has since reused no longer holds
+// the result's tag and gives no latency.
+//--------------------------------------
+static const uint32_t SEND_LOG = 1 << 16;
+
+struct SendLog {
+  std::atomic<uint32_t> seq[SEND_LOG];
+  std::atomic<int64_t>  ns[SEND_LOG];
+  std::atomic<uint32_t> sent;   // tag of the last message handed to the FPGA
+};
+
+static SendLog send_log;
+
+//--------------------------------------
+// Pin the calling thread to one CPU (-1: leave it to the scheduler)
+//--------------------------------------
+static void pin_to_cpu(int cpu, const char* name) {
+  if (cpu < 0) return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+    fprintf(stderr, "Warning: could not pin the %s thread to CPU %d\n", name, cpu);
+  }
+}
+
+//--------------------------------------
+// Host options
+//--------------------------------------
+struct HostOptions {
+  long     params_at = -1;
+  float    params[PARAM_WORDS];
+  uint64_t expiry_ns = 0;
+  uint32_t vol_push  = 0;
+  std::vector<PositionUpdate> positions;
+  long     risk_from = -1;   // messages sent before the first position
+  int      writer_cpu = 0;
+  int      reader_cpu = 1;
+  size_t   batch_words = IO_BATCH_WORDS;
+  int      flush_messages = IO_FLUSH_MESSAGES;
+  int      flush_us       = IO_FLUSH_US;
+};
+
+//--------------------------------------
+// Writer thread: commands, then every message of the file, then the sync
+// marker. Returns the number of messages sent. Stops early, without the
+// marker, if the write channel fails (raising io_stop) or the reader has
+// raised it.
+//--------------------------------------
+static int write_feed(int fdw, ITCH::Reader& reader, const HostOptions& opts) {
+  pin_to_cpu(opts.writer_cpu, "writer");
+
+  WordWriter  out(fdw, opts.batch_words, opts.flush_messages, (int64_t)opts.flush_us * 1000);
   const char* buffer;
-  int nbytes;
   int messages_sent = 0;
 
-  timer.start();
+  if (opts.expiry_ns) send_expiry(out, opts.expiry_ns);
+  if (opts.vol_push) out.put(((uint32_t)HDR_CMD_VOL << 24) | opts.vol_push);
 
   // Loop through all messages in the file
-  while ((buffer = reader.nextMessage())) {
+  while (out.ok() && !io_stop.load(std::memory_order_relaxed) && (buffer = reader.nextMessage())) {
+      if (messages_sent == opts.params_at) send_params(out, opts.params);
+      send_positions(out, opts.positions, messages_sent);
+
       uint16_t message_length = ITCH::Parser::getMessageLength(buffer);
-      
-      // 1. Send the message length (as a 32-bit integer)
-      uint32_t length_to_send = message_length;
-      nbytes = write(fdw, (void*)&length_to_send, sizeof(length_to_send));
-      assert(nbytes == sizeof(length_to_send));
 
-      // 2. Send the message body, word by word (32-bit)
+      // 1. Log the send time under the message's tag (the time it is
+      // formatted, so latencies include the wait for the batch to go out,
+      // which the flush thresholds bound)
+      uint32_t seq     = messages_sent + 1;
+      uint32_t slot    = seq & (SEND_LOG - 1);
+      int64_t  sent_ns = now_ns();
+      send_log.seq[slot].store(0, std::memory_order_relaxed);
+      send_log.ns[slot].store(sent_ns, std::memory_order_relaxed);
+      send_log.seq[slot].store(seq, std::memory_order_release);
+      send_log.sent.store(seq, std::memory_order_release);
+
+      // 2. Format the message length (as a 32-bit integer), then the body
+      // word by word (32-bit), into the batch
       // The message from the reader does not include the length field
-      for (int i = 0; i < ceil(message_length / 4.0); ++i) {
+      uint32_t words[1 + ITCH_BUFFER_BYTES / 4];
+      int      n_words = 1 + (message_length + 3) / 4;
+      assert(n_words <= (int)(sizeof(words) / sizeof(words[0])));
+      words[0] = message_length;
+      for (int i = 0; i < n_words - 1; ++i) {
 
         uint32_t word = 0;
         int remaining = message_length - i * 4;
@@ -72,51 +310,295 @@ int main(int argc, char **argv) {
             unsigned char byte = static_cast<unsigned char>(buffer[2 + i*4 + b]);
             word |= (uint32_t)byte << (8 * (3 - b));
         }
-
-        // std::cout << "Writing word: 0x" << std::hex << word << std::dec << std::endl;
-        nbytes = write(fdw, (void*)&word, sizeof(word));
-        assert(nbytes == sizeof(word));
+        words[1 + i] = word;
       }
+      out.put(words, n_words);
+      out.end_message(sent_ns);
       messages_sent++;
   }
 
-  // std::cout << "All messages sent (" << messages_sent << " total). Waiting for results from FPGA..." << std::endl;
+  if (out.ok() && !io_stop.load(std::memory_order_relaxed)) {
+    if (opts.params_at >= messages_sent) send_params(out, opts.params);
 
-  // Read results from the FPGA
-  // Expect one 64-bit result (call + put prices) per message sent
-  uint64_t result_data;
-  int results_received = 0;
-  
-  for (int i = 0; i < messages_sent; i++) {
-    // std::cout << "Receiving result " << (i+1) << " of " << messages_sent << "..." << std::endl;
-      nbytes = read(fdr, (void*)&result_data, sizeof(result_data));
-      if (nbytes <= 0) {
-          std::cerr << "Error: Expected " << messages_sent << " results but only received " << results_received << std::endl;
-          break;
+    // Mark the end of the input; the FPGA echoes the marker after the last
+    // result
+    out.put((uint32_t)HDR_CMD_SYNC << 24);
+    out.flush();
+  }
+  if (!out.ok() && !io_stop.exchange(true)) {
+    std::cerr << "Error: write channel failed after " << messages_sent << " messages" << std::endl;
+  }
+
+  return messages_sent;
+}
+
+//--------------------------------------
+// Reader thread: drains both read channels while the writer is still
+// sending, so the FPGA's output FIFOs never fill. Expect, up to a sync
+// marker on each channel:
+//  - on the BBO channel, a top-of-book update (sequence tag, BBO_WORDS
+//    words) for each message that changed the touch
+//  - on the result channel, a tagged result (sequence tag, one price per
+//    contract, and the portfolio risk once positions are loaded) for each
+//    message that moved the spot
+// Tags must rise and name a message already sent; results are matched to
+// the send log for their latency. Reading one channel to its end first
+// could leave the FPGA blocked on the other, so both are polled. Each
+// channel is read in batches; a channel with words left in its buffer is
+// served before polling again. On any failure the reader raises io_stop,
+// so the writer stops too, and gives up itself once the writer has.
+//--------------------------------------
+struct ReadStats {
+  int      results_received = 0;
+  int      bbo_received     = 0;
+  int      out_of_order     = 0;   // results whose tag is not after the last, or not sent yet
+  int      matched          = 0;   // results with a send time
+  double   latency_sum_ns   = 0;
+  int64_t  latency_max_ns   = 0;
+  float    risk[RISK_WORDS];
+  bool     risk_seen = false;
+  uint32_t bbo[BBO_WORDS] = { 0 };
+};
+
+static void read_results(int fdr, int fdb, const HostOptions& opts, ReadStats& st) {
+  pin_to_cpu(opts.reader_cpu, "reader");
+
+  WordReader out(fdr, opts.batch_words);
+  WordReader bbo(fdb, opts.batch_words);
+  uint32_t tag;
+  uint32_t last_seq = 0;
+  bool     out_done = false, bbo_done = false;
+
+  while (!out_done || !bbo_done) {
+      bool out_ready = !out_done && out.buffered();
+      bool bbo_ready = !bbo_done && bbo.buffered();
+      if (!out_ready && !bbo_ready) {
+          struct pollfd fds[2] = { { out_done ? -1 : fdr, POLLIN, 0 },
+                                   { bbo_done ? -1 : fdb, POLLIN, 0 } };
+          int ready = poll(fds, 2, IO_POLL_MS);
+          if (ready < 0 && errno != EINTR) {
+              std::cerr << "Error: poll failed" << std::endl;
+              break;
+          }
+          if (ready <= 0) {
+              if (io_stop.load(std::memory_order_relaxed)) break;
+              continue;
+          }
+          out_ready = fds[0].revents != 0;
+          bbo_ready = fds[1].revents != 0;
       }
-      assert(nbytes == sizeof(result_data));
-      
-      // Extract call and put prices from the 64-bit result
-      uint32_t call_bits = result_data & 0xFFFFFFFF;
-      uint32_t put_bits = (result_data >> 32) & 0xFFFFFFFF;
-      
-      float call_price, put_price;
-      memcpy(&call_price, &call_bits, sizeof(float));
-      memcpy(&put_price, &put_bits, sizeof(float));
-      
-      // std::cout << "Message " << (i+1) << ": Call=" << call_price << ", Put=" << put_price << std::endl;
-      results_received++;
+
+      if (bbo_ready) {
+          bool complete = bbo.next(&tag);
+          if (complete && (tag & OUT_TAG_SYNC)) {
+              bbo_done = true;
+          } else {
+              for (int w = 0; w < BBO_WORDS && complete; w++) complete = bbo.next(&st.bbo[w]);
+              if (!complete) {
+                  std::cerr << "Error: BBO channel stopped after " << st.bbo_received << " updates" << std::endl;
+                  break;
+              }
+              // std::cout << "Message " << tag << ": Bid=" << st.bbo[0] << "x" << st.bbo[1]
+              //           << ", Ask=" << st.bbo[2] << "x" << st.bbo[3] << std::endl;
+              st.bbo_received++;
+          }
+      }
+
+      if (out_ready) {
+          if (!out.next(&tag)) {
+              std::cerr << "Error: FPGA stopped after " << st.results_received << " results" << std::endl;
+              break;
+          }
+          if (tag & OUT_TAG_SYNC) {
+              out_done = true;
+              continue;
+          }
+          int64_t received_ns = now_ns();
+
+          float prices[CHAIN_CONTRACTS];
+          bool  complete = true;
+          for (int c = 0; c < CHAIN_CONTRACTS && complete; c++) {
+              uint32_t price_bits = 0;
+              complete = out.next(&price_bits);
+              memcpy(&prices[c], &price_bits, sizeof(float));
+          }
+          uint32_t seq = tag & (TAG_SPOT_INVALID - 1);
+          if (complete && opts.risk_from >= 0 && seq > (uint32_t)opts.risk_from) {
+              for (int w = 0; w < RISK_WORDS && complete; w++) {
+                  uint32_t risk_bits = 0;
+                  complete = out.next(&risk_bits);
+                  memcpy(&st.risk[w], &risk_bits, sizeof(float));
+              }
+              st.risk_seen = true;
+          }
+          if (!complete) {
+              std::cerr << "Error: truncated result for message " << tag << std::endl;
+              break;
+          }
+
+          // Match to the send order
+          if (seq <= last_seq || seq > send_log.sent.load(std::memory_order_acquire)) {
+              st.out_of_order++;
+          } else {
+              uint32_t slot = seq & (SEND_LOG - 1);
+              if (send_log.seq[slot].load(std::memory_order_acquire) == seq) {
+                  int64_t sent_ns = send_log.ns[slot].load(std::memory_order_relaxed);
+                  if (send_log.seq[slot].load(std::memory_order_acquire) == seq) {
+                      int64_t latency = received_ns - sent_ns;
+                      st.latency_sum_ns += latency;
+                      st.latency_max_ns  = std::max(st.latency_max_ns, latency);
+                      st.matched++;
+                  }
+              }
+          }
+          last_seq = seq;
+
+          // std::cout << "Message " << tag << ": Call=" << prices[0] << ", Put=" << prices[1] << std::endl;
+          st.results_received++;
+      }
+  }
+  if (!out_done || !bbo_done) io_stop.store(true);
+}
+
+//--------------------------------------
+// main function
+//  usage: hft-fpga [--params N K r v T] [--expiry DAYS] [--vol-push MS]
+//                  [--position N CONTRACT QTY]... [--cpus W R] [--batch WORDS]
+//                  [--flush MSGS US]
+//         --params:   load pricing parameters after N messages (0 = before
+//                     the feed)
+//         --expiry:   T counts down to DAYS days after midnight of the feed
+//                     day, from the message timestamps
+//         --vol-push: replace v by the realized volatility every MS ms of
+//                     feed time
+//         --position: hold QTY (negative: short) of chain contract CONTRACT
+//                     (0 to CHAIN_CONTRACTS - 1) from after N messages;
+//                     repeat for more contracts
+//         --cpus:     pin the writer thread to CPU W and the reader to CPU R
+//                     (default 0 and 1; -1 leaves a thread unpinned)
+//         --batch:    write and read the channels WORDS 32-bit words at a
+//                     time (default IO_BATCH_WORDS)
+//         --flush:    also send the write batch once it holds MSGS messages
+//                     or its first message is US microseconds old (default
+//                     IO_FLUSH_MESSAGES and IO_FLUSH_US; 0 turns one off).
+//                     With both off a message can wait on a whole batch,
+//                     and no result latency is reported.
+//--------------------------------------
+int main(int argc, char **argv) {
+  HostOptions opts;
+  for (int a = 1; a < argc; ) {
+    std::string opt = argv[a];
+    if (opt == "--params" && a + 1 + 1 + PARAM_WORDS <= argc) {
+      opts.params_at = atol(argv[a + 1]);
+      for (int i = 0; i < PARAM_WORDS; i++) opts.params[i] = atof(argv[a + 2 + i]);
+      a += 2 + PARAM_WORDS;
+    } else if (opt == "--expiry" && a + 2 <= argc) {
+      opts.expiry_ns = (uint64_t)(atof(argv[a + 1]) * 86400e9);
+      a += 2;
+    } else if (opt == "--vol-push" && a + 2 <= argc) {
+      opts.vol_push = atoi(argv[a + 1]) & 0xFFFF;
+      a += 2;
+    } else if (opt == "--position" && a + 4 <= argc && atol(argv[a + 1]) >= 0 &&
+               atoi(argv[a + 2]) >= 0 && atoi(argv[a + 2]) < CHAIN_CONTRACTS) {
+      // The FPGA drops an update past the chain and adds no risk words for
+      // it, so only one it will take may start the reader on them
+      PositionUpdate p = { atol(argv[a + 1]), (uint32_t)atoi(argv[a + 2]), (int32_t)atoi(argv[a + 3]) };
+      opts.positions.push_back(p);
+      if (opts.risk_from < 0 || p.at < opts.risk_from) opts.risk_from = p.at;
+      a += 4;
+    } else if (opt == "--cpus" && a + 3 <= argc) {
+      opts.writer_cpu = atoi(argv[a + 1]);
+      opts.reader_cpu = atoi(argv[a + 2]);
+      a += 3;
+    } else if (opt == "--batch" && a + 2 <= argc && atol(argv[a + 1]) > 0) {
+      opts.batch_words = atol(argv[a + 1]);
+      a += 2;
+    } else if (opt == "--flush" && a + 3 <= argc && atoi(argv[a + 1]) >= 0 && atoi(argv[a + 2]) >= 0) {
+      opts.flush_messages = atoi(argv[a + 1]);
+      opts.flush_us       = atoi(argv[a + 2]);
+      a += 3;
+    } else {
+      fprintf(stderr, "usage: %s [--params N K r v T] [--expiry DAYS] [--vol-push MS] "
+                      "[--position N CONTRACT QTY]... [--cpus W R] [--batch WORDS] [--flush MSGS US]\n", argv[0]);
+      exit(-1);
+    }
+  }
+
+  // Open channels to the FPGA board.
+  // These channels appear as files to the Linux OS: results and the
+  // top-of-book updates come back on separate read channels
+  int fdr = open("/dev/xillybus_read_32", O_RDONLY);
+  int fdb = open("/dev/xillybus_read_bbo_32", O_RDONLY);
+  int fdw = open("/dev/xillybus_write_32", O_WRONLY);
+
+  // Check that the channels are correctly opened
+  if ((fdr < 0) || (fdb < 0) || (fdw < 0)) {
+    fprintf(stderr, "Failed to open Xillybus device channels\n");
+    exit(-1);
+  }
+
+  // Writes wait in poll() instead, so the writer can be stopped (io_stop)
+  fcntl(fdw, F_SETFL, fcntl(fdw, F_GETFL) | O_NONBLOCK);
+
+  // Timer
+  Timer timer("FPGA Communication");
+
+  // Use ITCH Reader to open and parse a data file
+  ITCH::Reader reader(INPUT_ITCH_FILE);
+  if (!reader.isOpen()) {
+      std::cerr << "Failed to open data file: " << INPUT_ITCH_FILE << std::endl;
+      return -1;
   }
 
+  std::cout << "Sending ITCH messages to FPGA..." << std::endl;
+
+  // The reader starts first, so it is draining before the first result
+  ReadStats st;
+  int messages_sent = 0;
+
+  timer.start();
+  int64_t start_ns = now_ns();
+
+  std::thread reader_thread(read_results, fdr, fdb, std::cref(opts), std::ref(st));
+  std::thread writer_thread([&] { messages_sent = write_feed(fdw, reader, opts); });
+  writer_thread.join();
+  reader_thread.join();
+
+  double elapsed = (now_ns() - start_ns) * 1e-9;
   timer.stop();
 
   // Report 
   std::cout << "Finished." << std::endl;
-  std::cout << "Sent " << messages_sent << " messages and received " << results_received << " results." << std::endl;
+  std::cout << "Sent " << messages_sent << " messages and received " << st.results_received << " results and "
+            << st.bbo_received << " BBO updates." << std::endl;
+  std::cout << "Throughput: " << (elapsed > 0 ? messages_sent / elapsed : 0.0) << " msgs/sec" << std::endl;
+  // Without a flush threshold the latency is mostly the wait for a batch
+  // to fill, which says nothing about the FPGA
+  if (opts.flush_messages == 0 && opts.flush_us == 0) {
+    std::cout << "Result latency: not reported, the write batch only goes out when full (--flush 0 0)" << std::endl;
+  } else if (st.matched) {
+    std::cout << "Result latency: mean " << st.latency_sum_ns / st.matched / 1000.0 << " us, max "
+              << st.latency_max_ns / 1000.0 << " us over " << st.matched << " results" << std::endl;
+  }
+  if (st.out_of_order) {
+    std::cerr << "Error: " << st.out_of_order << " results out of send order" << std::endl;
+  }
+  if (st.bbo_received) {
+    std::cout << "Last BBO: " << st.bbo[0] / 10000.0 << " x " << st.bbo[1] << " / "
+              << st.bbo[2] / 10000.0 << " x " << st.bbo[3] << std::endl;
+  }
+  if (st.risk_seen) {
+    std::cout << "Portfolio at the last result: value=" << st.risk[0] << " delta=" << st.risk[1]
+              << " gamma=" << st.risk[2] << std::endl;
+  }
+  if (io_stop.load()) {
+    std::cerr << "Error: the run stopped early; counts above are partial" << std::endl;
+  }
 
   // Close the channels
   close(fdr);
+  close(fdb);
   close(fdw);
 
-  return 0;
-}
\ No newline at end of file
+  return io_stop.load() ? -1 : 0;
+}
@@ -0,0 +1 @@
+../ecelinux/price_heap.hpp
\ No newline at end of file
@@ -0,0 +1 @@
+../ecelinux/tape.hpp
\ No newline at end of file